@@ -0,0 +1,212 @@
+/* cxxbench.cpp -- example program: the C++ interface and its cost
+
+   This file is part of the LZO real-time data compression library.
+
+   Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   The LZO library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   The LZO library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the LZO library; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+   http://www.oberhumer.com/opensource/lzo/
+ */
+
+
+/*************************************************************************
+// This program compresses a file in blocks with lzo::Codec from
+// <lzo/lzo.hpp> and with the C functions it wraps, and prints the
+// speed of both. The two must produce the same bytes, and should run
+// at the same speed.
+//
+// usage: cxxbench [-n#] file...
+**************************************************************************/
+
+#include <lzo/lzo.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+static const std::size_t BLOCK_LEN = 256 * 1024;
+
+typedef std::vector<unsigned char> bytes;
+
+
+/*************************************************************************
+// time the best of `rounds' runs of f()
+**************************************************************************/
+
+template <class F>
+static double best_time(int rounds, F f)
+{
+    double best = 1e30;
+
+    for (int i = 0; i < rounds; i++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - t0;
+        best = std::min(best, d.count());
+    }
+    return best;
+}
+
+static double mbs(std::size_t len, double secs)
+{
+    return secs > 0 ? len / secs / 1e6 : 0.0;
+}
+
+
+/*************************************************************************
+//
+**************************************************************************/
+
+template <lzo::Algorithm A, int Level>
+static bool bench(const char *method, const char *name, const bytes &data, int rounds,
+                  int (*c_compress)(const lzo_bytep, lzo_uint, lzo_bytep, lzo_uintp, lzo_voidp),
+                  int (*c_decompress)(const lzo_bytep, lzo_uint, lzo_bytep, lzo_uintp, lzo_voidp))
+{
+    typedef lzo::Codec<A, Level> codec_t;
+    const std::size_t nblocks = (data.size() + BLOCK_LEN - 1) / BLOCK_LEN;
+    const std::size_t slot = lzo::compress_bound(BLOCK_LEN);
+    bytes out_c(nblocks * slot), out_cxx(nblocks * slot), back(BLOCK_LEN);
+    std::vector<lzo_uint> lens_c(nblocks);
+    std::vector<std::size_t> lens_cxx(nblocks);
+    std::vector<unsigned char> wrkmem(codec_t::wrkmem_size);
+    codec_t codec;
+    std::size_t packed = 0;
+    double tc[4];
+
+    auto c_run = [&]() {
+        for (std::size_t i = 0; i < nblocks; i++)
+        {
+            const std::size_t len = std::min(BLOCK_LEN, data.size() - i * BLOCK_LEN);
+            lens_c[i] = slot;
+            c_compress(const_cast<lzo_bytep>(&data[i * BLOCK_LEN]), len,
+                       &out_c[i * slot], &lens_c[i], wrkmem.data());
+        }
+    };
+    auto cxx_run = [&]() {
+        for (std::size_t i = 0; i < nblocks; i++)
+        {
+            const std::size_t len = std::min(BLOCK_LEN, data.size() - i * BLOCK_LEN);
+            lens_cxx[i] = codec.compress(lzo::span<const unsigned char>(&data[i * BLOCK_LEN], len),
+                                         lzo::span<unsigned char>(&out_cxx[i * slot], slot));
+        }
+    };
+    auto c_back = [&]() {
+        for (std::size_t i = 0; i < nblocks; i++)
+        {
+            lzo_uint len = BLOCK_LEN;
+            c_decompress(&out_c[i * slot], lens_c[i], back.data(), &len, nullptr);
+        }
+    };
+    auto cxx_back = [&]() {
+        for (std::size_t i = 0; i < nblocks; i++)
+            codec_t::decompress(lzo::span<const unsigned char>(&out_cxx[i * slot], lens_cxx[i]), back);
+    };
+
+    /* interleave the runs, so that both see the same machine state */
+    tc[0] = tc[1] = tc[2] = tc[3] = 1e30;
+    for (int r = 0; r < rounds; r++)
+    {
+        tc[0] = std::min(tc[0], best_time(1, c_run));
+        tc[1] = std::min(tc[1], best_time(1, cxx_run));
+        tc[2] = std::min(tc[2], best_time(1, c_back));
+        tc[3] = std::min(tc[3], best_time(1, cxx_back));
+    }
+
+    for (std::size_t i = 0; i < nblocks; i++)
+    {
+        const std::size_t len = std::min(BLOCK_LEN, data.size() - i * BLOCK_LEN);
+
+        if (lens_c[i] != lens_cxx[i] || std::memcmp(&out_c[i * slot], &out_cxx[i * slot], lens_c[i]) != 0)
+        {
+            std::printf("%s: %s: C and C++ output differ in block %lu\n", method, name, (unsigned long) i);
+            return false;
+        }
+        if (codec_t::decompress(lzo::span<const unsigned char>(&out_cxx[i * slot], lens_cxx[i]), back) != len ||
+            std::memcmp(back.data(), &data[i * BLOCK_LEN], len) != 0)
+        {
+            std::printf("%s: %s: decompression failed in block %lu\n", method, name, (unsigned long) i);
+            return false;
+        }
+        packed += lens_c[i];
+    }
+
+    std::printf("%-12s | %-14s %9lu %9lu | compress C %8.2f C++ %8.2f MB/s | decompress C %8.2f C++ %8.2f MB/s\n",
+                method, name, (unsigned long) data.size(), (unsigned long) packed,
+                mbs(data.size(), tc[0]), mbs(data.size(), tc[1]),
+                mbs(data.size(), tc[2]), mbs(data.size(), tc[3]));
+    return true;
+}
+
+
+/*************************************************************************
+//
+**************************************************************************/
+
+int __lzo_cdecl_main main(int argc, char *argv[])
+{
+    int rounds = 5;
+    int i = 1;
+    bool ok = true;
+
+    if (lzo_init() != LZO_E_OK)
+    {
+        std::printf("internal error - lzo_init() failed !!!\n");
+        return 1;
+    }
+
+    if (i < argc && argv[i][0] == '-' && argv[i][1] == 'n')
+        rounds = std::max(1, std::atoi(&argv[i++][2]));
+    if (i >= argc)
+    {
+        std::printf("usage: %s [-n#] file...\n", argv[0]);
+        return 1;
+    }
+
+    for ( ; i < argc; i++)
+    {
+        std::ifstream f(argv[i], std::ios::binary);
+        bytes data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        const char *name = std::strrchr(argv[i], '/') ? std::strrchr(argv[i], '/') + 1 : argv[i];
+
+        if (!f.good() && !f.eof())
+        {
+            std::printf("%s: cannot read %s\n", argv[0], argv[i]);
+            ok = false;
+            continue;
+        }
+        ok &= bench<lzo::Algorithm::LZO1X, 1>("LZO1X-1", name, data, rounds,
+                                             &lzo1x_1_compress, &lzo1x_decompress_safe);
+        ok &= bench<lzo::Algorithm::LZO1Y, 1>("LZO1Y-1", name, data, rounds,
+                                             &lzo1y_1_compress, &lzo1y_decompress_safe);
+        ok &= bench<lzo::Algorithm::LZO1X, 9>("LZO1X-999", name, data, 1,
+                                             &lzo1x_999_compress, &lzo1x_decompress_safe);
+    }
+
+    return ok ? 0 : 1;
+}
+
+
+/* vim:set ts=4 sw=4 et: */
@@ -0,0 +1,224 @@
+/* cxxpack.cpp -- example program: lzopack with the C++ stream interface
+
+   This file is part of the LZO real-time data compression library.
+
+   Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   The LZO library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   The LZO library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the LZO library; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+   http://www.oberhumer.com/opensource/lzo/
+ */
+
+
+/*************************************************************************
+// This program does the same as lzopack.c, but with lzo::StreamCompressor
+// and lzo::StreamDecompressor from <lzo/lzo.hpp>. The files can be
+// exchanged with lzopack.
+//
+// usage: cxxpack [-9] input-file output-file     (compress)
+//        cxxpack -d input-file output-file       (decompress)
+//        cxxpack -t file...                      (test)
+//
+// The test mode compresses and decompresses each file in chunks of odd
+// sizes, and checks that no memory is allocated after the first file.
+**************************************************************************/
+
+#include <lzo/lzo.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory_resource>
+#include <vector>
+
+typedef std::vector<unsigned char> bytes;
+
+
+/*************************************************************************
+// a memory_resource that counts the allocations
+**************************************************************************/
+
+class counting_resource : public std::pmr::memory_resource
+{
+public:
+    unsigned long count = 0;
+
+private:
+    void *do_allocate(std::size_t n, std::size_t align) override
+    {
+        count++;
+        return std::pmr::new_delete_resource()->allocate(n, align);
+    }
+    void do_deallocate(void *p, std::size_t n, std::size_t align) override
+    {
+        std::pmr::new_delete_resource()->deallocate(p, n, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &o) const noexcept override
+    {
+        return this == &o;
+    }
+};
+
+
+/*************************************************************************
+// compress or decompress a file
+**************************************************************************/
+
+static bool pack(const char *in_name, const char *out_name, bool decompress, int level)
+{
+    std::ifstream fi(in_name, std::ios::binary);
+    std::ofstream fo(out_name, std::ios::binary);
+    std::vector<char> buf(64 * 1024);
+    auto sink = [&](lzo::span<const unsigned char> s) {
+        fo.write(reinterpret_cast<const char *>(s.data()), (std::streamsize) s.size());
+    };
+
+    if (!fi || !fo)
+    {
+        std::printf("cxxpack: cannot open %s\n", !fi ? in_name : out_name);
+        return false;
+    }
+    try
+    {
+        lzo::StreamCompressor c(level);
+        lzo::StreamDecompressor d;
+
+        while (fi)
+        {
+            fi.read(buf.data(), (std::streamsize) buf.size());
+            lzo::span<const unsigned char> chunk(reinterpret_cast<const unsigned char *>(buf.data()),
+                                                 (std::size_t) fi.gcount());
+            if (decompress)
+                d.write(chunk, sink);
+            else
+                c.write(chunk, sink);
+        }
+        if (decompress)
+            d.finish();
+        else
+            c.finish(sink);
+    }
+    catch (const lzo::error &e)
+    {
+        std::printf("cxxpack: %s: %s\n", in_name, e.what());
+        return false;
+    }
+    if (!fo.flush())
+    {
+        std::printf("cxxpack: write error on %s\n", out_name);
+        return false;
+    }
+    return true;
+}
+
+
+/*************************************************************************
+// compress and decompress a file in memory, in chunks of odd sizes
+**************************************************************************/
+
+static bool test(lzo::StreamCompressor &c, lzo::StreamDecompressor &d, const bytes &data, std::size_t step)
+{
+    bytes packed, back;
+    auto put_packed = [&](lzo::span<const unsigned char> s) { packed.insert(packed.end(), s.begin(), s.end()); };
+    auto put_back = [&](lzo::span<const unsigned char> s) { back.insert(back.end(), s.begin(), s.end()); };
+    std::size_t i;
+
+    c.reset();
+    d.reset();
+    for (i = 0; i < data.size(); i += step)
+        c.write(lzo::span<const unsigned char>(&data[i], std::min(step, data.size() - i)), put_packed);
+    c.finish(put_packed);
+    step = step * 3 + 1;
+    for (i = 0; i < packed.size(); i += step)
+        d.write(lzo::span<const unsigned char>(&packed[i], std::min(step, packed.size() - i)), put_back);
+    d.finish();
+    return back == data;
+}
+
+static int run_tests(int argc, char *argv[])
+{
+    static const std::size_t steps[] = { 1, 7, 4093, 65536, 1000000 };
+    counting_resource mr;
+    lzo::StreamCompressor c1(1, 4096, &mr), c9(9, 16384, &mr);
+    lzo::StreamDecompressor d(&mr);
+    unsigned long allocs = 0;
+    bool ok = true;
+
+    for (int i = 0; i < argc; i++)
+    {
+        std::ifstream f(argv[i], std::ios::binary);
+        bytes data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+        for (std::size_t step : steps)
+        {
+            if (step == 1 && data.size() > 100000)
+                continue;
+            if (!test(c1, d, data, step) || !test(c9, d, data, step))
+            {
+                std::printf("cxxpack: %s: round trip failed with chunks of %lu bytes\n",
+                            argv[i], (unsigned long) step);
+                ok = false;
+            }
+            /* the decompressor allocates its buffer on the first header */
+            if (allocs == 0)
+                allocs = mr.count;
+            else if (mr.count != allocs)
+            {
+                std::printf("cxxpack: %s: %lu allocations in steady state\n",
+                            argv[i], mr.count - allocs);
+                ok = false;
+                allocs = mr.count;
+            }
+        }
+        std::printf("cxxpack: %s: %s\n", argv[i], ok ? "ok" : "FAILED");
+    }
+    return ok ? 0 : 1;
+}
+
+
+/*************************************************************************
+//
+**************************************************************************/
+
+int __lzo_cdecl_main main(int argc, char *argv[])
+{
+    if (lzo_init() != LZO_E_OK)
+    {
+        std::printf("internal error - lzo_init() failed !!!\n");
+        return 1;
+    }
+
+    if (argc >= 3 && std::strcmp(argv[1], "-t") == 0)
+        return run_tests(argc - 2, argv + 2);
+    if (argc == 4 && std::strcmp(argv[1], "-d") == 0)
+        return pack(argv[2], argv[3], true, 1) ? 0 : 1;
+    if (argc == 4 && std::strcmp(argv[1], "-9") == 0)
+        return pack(argv[2], argv[3], false, 9) ? 0 : 1;
+    if (argc == 3)
+        return pack(argv[1], argv[2], false, 1) ? 0 : 1;
+
+    std::printf("usage: %s [-9] input-file output-file     (compress)\n", argv[0]);
+    std::printf("       %s -d input-file output-file       (decompress)\n", argv[0]);
+    std::printf("       %s -t file...                      (test)\n", argv[0]);
+    return 1;
+}
+
+
+/* vim:set ts=4 sw=4 et: */
@@ -0,0 +1,175 @@
+/* dtrain.c -- example program: how to build a preset dictionary
+
+   This file is part of the LZO real-time data compression library.
+
+   Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   The LZO library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   The LZO library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the LZO library; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+   http://www.oberhumer.com/opensource/lzo/
+ */
+
+
+/*************************************************************************
+// This program builds a dictionary from a set of sample files. Each
+// file is one sample. The result can be used with dict.c or with
+// `lzotest --dict=FILE'.
+//
+// Please study dict.c first.
+**************************************************************************/
+
+#include <lzo/lzoconf.h>
+#include <lzo/lzo1x.h>
+
+/* portability layer */
+static const char *progname = NULL;
+#define WANT_LZO_MALLOC 1
+#define WANT_LZO_FREAD 1
+#define WANT_LZO_WILDARGV 1
+#define WANT_XMALLOC 1
+#include "examples/portab.h"
+
+
+#define DICT_LEN        0xbfff
+#define MAX_TOTAL_LEN   (256L * 1024L * 1024L)
+
+
+/*************************************************************************
+//
+**************************************************************************/
+
+int __lzo_cdecl_main main(int argc, char *argv[])
+{
+    int i = 1;
+    int r;
+    lzo_bytep samples = NULL;
+    lzo_uint *sample_lens;
+    lzo_uint nsamples = 0;
+    lzo_uint total = 0;
+    lzo_bytep dict;
+    lzo_uint dict_len = DICT_LEN;
+    lzo_voidp wrkmem;
+    const char *dict_name;
+    FILE *fp;
+
+    lzo_wildargv(&argc, &argv);
+
+    printf("\nLZO real-time data compression library (v%s, %s).\n",
+           lzo_version_string(), lzo_version_date());
+    printf("Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer\nAll Rights Reserved.\n\n");
+
+    progname = argv[0];
+
+    if (i < argc && argv[i][0] == '-' && isdigit(argv[i][1]))
+        dict_len = (lzo_uint) atol(&argv[i++][1]);
+
+    if (i + 1 >= argc || dict_len < 1 || dict_len > DICT_LEN)
+    {
+        printf("usage: %s [-size] dictionary-file sample-file...\n", progname);
+        exit(1);
+    }
+
+/*
+ * Step 1: initialize the LZO library
+ */
+    if (lzo_init() != LZO_E_OK)
+    {
+        printf("internal error - lzo_init() failed !!!\n");
+        printf("(this usually indicates a compiler bug - try recompiling\nwithout optimizations, and enable '-DLZO_DEBUG' for diagnostics)\n");
+        exit(1);
+    }
+
+/*
+ * Step 2: read all samples into one buffer
+ */
+    dict_name = argv[i++];
+    sample_lens = (lzo_uint *) xmalloc((lzo_uint) (argc - i) * sizeof(lzo_uint));
+    for ( ; i < argc; i++)
+    {
+        long l;
+        lzo_bytep p;
+
+        fp = fopen(argv[i],"rb");
+        if (fp == NULL)
+        {
+            printf("%s: %s: cannot open file -- skipping\n", progname, argv[i]);
+            continue;
+        }
+        fseek(fp, 0, SEEK_END);
+        l = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        if (l <= 0 || l > MAX_TOTAL_LEN - (long) total)
+        {
+            printf("%s: %s: empty or too big -- skipping\n", progname, argv[i]);
+            fclose(fp); fp = NULL;
+            continue;
+        }
+        p = (lzo_bytep) xmalloc(total + (lzo_uint) l);
+        if (total > 0)
+            lzo_memcpy(p, samples, total);
+        lzo_free(samples);
+        samples = p;
+        sample_lens[nsamples] = (lzo_uint) lzo_fread(fp, samples + total, (lzo_uint) l);
+        total += sample_lens[nsamples++];
+        fclose(fp); fp = NULL;
+    }
+
+/*
+ * Step 3: train the dictionary
+ */
+    dict = (lzo_bytep) xmalloc(dict_len);
+    wrkmem = (lzo_voidp) xmalloc(LZO1X_TRAIN_DICT_MEM);
+    r = lzo1x_train_dict(samples, sample_lens, nsamples, dict, &dict_len, wrkmem);
+    if (r != LZO_E_OK)
+    {
+        /* this should NEVER happen */
+        printf("internal error - training failed: %d\n", r);
+        return 1;
+    }
+
+/*
+ * Step 4: write the dictionary
+ */
+    fp = fopen(dict_name,"wb");
+    if (fp == NULL)
+    {
+        printf("%s: cannot create dictionary file %s\n", progname, dict_name);
+        exit(1);
+    }
+    if (lzo_fwrite(fp, dict, dict_len) != dict_len)
+    {
+        printf("%s: write error on dictionary file %s\n", progname, dict_name);
+        exit(1);
+    }
+    fclose(fp); fp = NULL;
+
+    printf("Trained dictionary '%s', %ld bytes from %ld samples (%ld bytes), ID 0x%08lx.\n",
+           dict_name, (long) dict_len, (long) nsamples, (long) total,
+           (unsigned long) lzo_adler32(lzo_adler32(0, NULL, 0), dict, dict_len));
+
+    /* free buffers in reverse order to help malloc() */
+    lzo_free(wrkmem);
+    lzo_free(dict);
+    lzo_free(sample_lens);
+    lzo_free(samples);
+    return 0;
+}
+
+
+/* vim:set ts=4 sw=4 et: */
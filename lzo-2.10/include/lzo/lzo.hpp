@@ -0,0 +1,683 @@
+/* lzo.hpp -- C++17 interface of the LZO compression library
+
+   This file is part of the LZO real-time data compression library.
+
+   Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   The LZO library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   The LZO library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the LZO library; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+   http://www.oberhumer.com/opensource/lzo/
+ */
+
+
+#ifndef __LZO_HPP_INCLUDED
+#define __LZO_HPP_INCLUDED 1
+
+#if !defined(__cplusplus) || (__cplusplus < 201703L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 201703L))
+#  error "lzo.hpp needs C++17"
+#endif
+
+#include <lzo/lzoconf.h>
+#include <lzo/lzo1.h>
+#include <lzo/lzo1a.h>
+#include <lzo/lzo1b.h>
+#include <lzo/lzo1c.h>
+#include <lzo/lzo1f.h>
+#include <lzo/lzo1x.h>
+#include <lzo/lzo1y.h>
+#include <lzo/lzo1z.h>
+#include <lzo/lzo2a.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#if defined(__has_include)
+#  if __has_include(<version>)
+#    include <version>
+#  endif
+#endif
+#if defined(__cpp_lib_span)
+#  include <span>
+#endif
+
+
+/***********************************************************************
+// Usage:
+//
+//   lzo::Codec<lzo::Algorithm::LZO1X, 1> codec;
+//   std::vector<unsigned char> out(codec.compress_bound(in.size()));
+//   out.resize(codec.compress(in, out));
+//   ...
+//   std::size_t n = codec.decompress(out, buf);
+//
+// The algorithm and the level are template arguments, so each call
+// goes straight to the C function, which the compiler can inline.
+// Level 1 and 9 are the fast and the 999 compressor (the 99 one for
+// LZO1 and LZO1A); LZO1Z and LZO2A only have the 999 compressor, which
+// is used for every level. LZO1X, LZO1Y and LZO1Z have level 10 too.
+// This is the same choice as in the Python module, so data can be
+// exchanged with lzo.compress(..., header=False).
+//
+// Errors throw lzo::error. Decompression uses the safe decompressor,
+// except for LZO1 and LZO1A, which do not have one.
+//
+// StreamCompressor and StreamDecompressor turn a stream of chunks into
+// the block format of examples/lzopack.c and back, see below.
+************************************************************************/
+
+namespace lzo {
+
+enum class Algorithm { LZO1, LZO1A, LZO1B, LZO1C, LZO1F, LZO1X, LZO1Y, LZO1Z, LZO2A };
+
+
+/* std::span when the library has it, else a small stand-in */
+#if defined(__cpp_lib_span)
+template <class T>
+using span = std::span<T>;
+#else
+template <class T>
+class span
+{
+public:
+    using element_type = T;
+    using size_type = std::size_t;
+
+    constexpr span() noexcept : p_(nullptr), n_(0) {}
+    constexpr span(T *p, std::size_t n) noexcept : p_(p), n_(n) {}
+    template <std::size_t N>
+    constexpr span(T (&a)[N]) noexcept : p_(a), n_(N) {}
+    template <class C, class = std::enable_if_t<
+        std::is_convertible_v<decltype(std::declval<C &>().data()), T *> &&
+        !std::is_same_v<std::remove_cv_t<C>, span> > >
+    constexpr span(C &c) noexcept : p_(c.data()), n_(c.size()) {}
+    template <class U, class = std::enable_if_t<std::is_convertible_v<U (*)[], T (*)[]> > >
+    constexpr span(const span<U> &s) noexcept : p_(s.data()), n_(s.size()) {}
+
+    constexpr T *data() const noexcept { return p_; }
+    constexpr std::size_t size() const noexcept { return n_; }
+    constexpr bool empty() const noexcept { return n_ == 0; }
+    constexpr T *begin() const noexcept { return p_; }
+    constexpr T *end() const noexcept { return p_ + n_; }
+    constexpr T &operator[](std::size_t i) const noexcept { return p_[i]; }
+
+private:
+    T *p_;
+    std::size_t n_;
+};
+#endif
+
+
+class error : public std::runtime_error
+{
+public:
+    explicit error(int code)
+        : std::runtime_error("LZO error " + std::to_string(code)), code_(code) {}
+    error(int code, const char *what)
+        : std::runtime_error(what), code_(code) {}
+    /* one of the LZO_E_* values */
+    int code() const noexcept { return code_; }
+
+private:
+    int code_;
+};
+
+
+/* worst case size of the compressed data */
+constexpr std::size_t compress_bound(std::size_t in_len) noexcept
+{
+    return in_len + in_len / 16 + 64 + 3;
+}
+
+
+/***********************************************************************
+// the C functions for each algorithm and level
+************************************************************************/
+
+namespace detail {
+
+typedef int (*compress_fn)(const lzo_bytep, lzo_uint, lzo_bytep, lzo_uintp, lzo_voidp);
+typedef int (*decompress_fn)(const lzo_bytep, lzo_uint, lzo_bytep, lzo_uintp, lzo_voidp);
+
+template <std::size_t Mem, compress_fn F>
+struct compressor
+{
+    static constexpr std::size_t mem_compress = Mem;
+    static int compress(const lzo_bytep src, lzo_uint src_len, lzo_bytep dst, lzo_uintp dst_len, lzo_voidp wrkmem)
+    {
+        return F(src, src_len, dst, dst_len, wrkmem);
+    }
+};
+
+/* level 10 has no function of its own */
+template <int (*F)(const lzo_bytep, lzo_uint, lzo_bytep, lzo_uintp, lzo_voidp,
+                   const lzo_bytep, lzo_uint, lzo_callback_p, int)>
+inline int compress_level_10(const lzo_bytep src, lzo_uint src_len, lzo_bytep dst, lzo_uintp dst_len, lzo_voidp wrkmem)
+{
+    return F(src, src_len, dst, dst_len, wrkmem, nullptr, 0, nullptr, 10);
+}
+
+template <Algorithm A, int Level> struct level_traits;
+template <Algorithm A> struct decompressor;
+
+#define LZO_HPP_ALGORITHM(A, MEM_1, FN_1, MEM_9, FN_9, FN_D) \
+    template <> struct level_traits<Algorithm::A, 1> : compressor<MEM_1, &FN_1> {}; \
+    template <> struct level_traits<Algorithm::A, 9> : compressor<MEM_9, &FN_9> {}; \
+    template <> struct decompressor<Algorithm::A> { static constexpr decompress_fn decompress = &FN_D; };
+
+LZO_HPP_ALGORITHM(LZO1,  LZO1_MEM_COMPRESS,      lzo1_compress,      LZO1_99_MEM_COMPRESS,   lzo1_99_compress,   lzo1_decompress)
+LZO_HPP_ALGORITHM(LZO1A, LZO1A_MEM_COMPRESS,     lzo1a_compress,     LZO1A_99_MEM_COMPRESS,  lzo1a_99_compress,  lzo1a_decompress)
+LZO_HPP_ALGORITHM(LZO1B, LZO1B_MEM_COMPRESS,     lzo1b_1_compress,   LZO1B_999_MEM_COMPRESS, lzo1b_999_compress, lzo1b_decompress_safe)
+LZO_HPP_ALGORITHM(LZO1C, LZO1C_MEM_COMPRESS,     lzo1c_1_compress,   LZO1C_999_MEM_COMPRESS, lzo1c_999_compress, lzo1c_decompress_safe)
+LZO_HPP_ALGORITHM(LZO1F, LZO1F_MEM_COMPRESS,     lzo1f_1_compress,   LZO1F_999_MEM_COMPRESS, lzo1f_999_compress, lzo1f_decompress_safe)
+LZO_HPP_ALGORITHM(LZO1X, LZO1X_1_MEM_COMPRESS,   lzo1x_1_compress,   LZO1X_999_MEM_COMPRESS, lzo1x_999_compress, lzo1x_decompress_safe)
+LZO_HPP_ALGORITHM(LZO1Y, LZO1Y_MEM_COMPRESS,     lzo1y_1_compress,   LZO1Y_999_MEM_COMPRESS, lzo1y_999_compress, lzo1y_decompress_safe)
+LZO_HPP_ALGORITHM(LZO1Z, LZO1Z_999_MEM_COMPRESS, lzo1z_999_compress, LZO1Z_999_MEM_COMPRESS, lzo1z_999_compress, lzo1z_decompress_safe)
+LZO_HPP_ALGORITHM(LZO2A, LZO2A_999_MEM_COMPRESS, lzo2a_999_compress, LZO2A_999_MEM_COMPRESS, lzo2a_999_compress, lzo2a_decompress_safe)
+
+#undef LZO_HPP_ALGORITHM
+
+template <> struct level_traits<Algorithm::LZO1X, 10>
+    : compressor<LZO1X_999_10_MEM_COMPRESS, &compress_level_10<&lzo1x_999_compress_level> > {};
+template <> struct level_traits<Algorithm::LZO1Y, 10>
+    : compressor<LZO1Y_999_10_MEM_COMPRESS, &compress_level_10<&lzo1y_999_compress_level> > {};
+template <> struct level_traits<Algorithm::LZO1Z, 10>
+    : compressor<LZO1Z_999_10_MEM_COMPRESS, &compress_level_10<&lzo1z_999_compress_level> > {};
+
+template <class T, class = void>
+struct is_complete : std::false_type {};
+template <class T>
+struct is_complete<T, std::void_t<decltype(sizeof(T))> > : std::true_type {};
+
+/* a move-only block of memory from a memory_resource */
+class pmr_buffer
+{
+public:
+    pmr_buffer() noexcept : p_(nullptr), n_(0), mr_(nullptr) {}
+    pmr_buffer(std::size_t n, std::pmr::memory_resource *mr)
+        : p_(static_cast<unsigned char *>(mr->allocate(n, align))), n_(n), mr_(mr) {}
+    pmr_buffer(pmr_buffer &&o) noexcept
+        : p_(std::exchange(o.p_, nullptr)), n_(std::exchange(o.n_, 0)), mr_(o.mr_) {}
+    pmr_buffer &operator=(pmr_buffer &&o) noexcept
+    {
+        if (this != &o)
+        {
+            release();
+            p_ = std::exchange(o.p_, nullptr);
+            n_ = std::exchange(o.n_, 0);
+            mr_ = o.mr_;
+        }
+        return *this;
+    }
+    ~pmr_buffer() { release(); }
+
+    unsigned char *data() const noexcept { return p_; }
+    std::size_t size() const noexcept { return n_; }
+
+    static constexpr std::size_t align = 64;
+
+private:
+    void release() noexcept
+    {
+        if (p_ != nullptr)
+            mr_->deallocate(p_, n_, align);
+        p_ = nullptr;
+        n_ = 0;
+    }
+
+    unsigned char *p_;
+    std::size_t n_;
+    std::pmr::memory_resource *mr_;
+};
+
+/* big endian 32-bit integers, as in lzopack */
+inline void put32(unsigned char *b, lzo_uint32_t v) noexcept
+{
+    b[0] = (unsigned char) ((v >> 24) & 0xff);
+    b[1] = (unsigned char) ((v >> 16) & 0xff);
+    b[2] = (unsigned char) ((v >>  8) & 0xff);
+    b[3] = (unsigned char) ((v >>  0) & 0xff);
+}
+
+inline lzo_uint32_t get32(const unsigned char *b) noexcept
+{
+    return ((lzo_uint32_t) b[0] << 24) | ((lzo_uint32_t) b[1] << 16) |
+           ((lzo_uint32_t) b[2] <<  8) | ((lzo_uint32_t) b[3] <<  0);
+}
+
+/* lzo_init() checks the compiler settings; do it once per program */
+inline void ensure_init()
+{
+    static const int r = lzo_init();
+    if (r != LZO_E_OK)
+        throw error(r);
+}
+
+} // namespace detail
+
+
+/***********************************************************************
+// Codec
+************************************************************************/
+
+template <Algorithm A = Algorithm::LZO1X, int Level = 1>
+class Codec
+{
+    static_assert(detail::is_complete<detail::level_traits<A, Level> >::value,
+                  "no such level: use 1 or 9, or 10 for LZO1X, LZO1Y and LZO1Z");
+    typedef detail::level_traits<A, Level> traits;
+
+public:
+    static constexpr Algorithm algorithm = A;
+    static constexpr int level = Level;
+    static constexpr std::size_t wrkmem_size = traits::mem_compress;
+    static constexpr std::size_t wrkmem_align = 64;     /* a cache line */
+
+    static constexpr std::size_t compress_bound(std::size_t in_len) noexcept
+    {
+        return lzo::compress_bound(in_len);
+    }
+
+    Codec() : wrkmem_(allocate_wrkmem()) {}
+    Codec(Codec &&) noexcept = default;
+    Codec &operator=(Codec &&) noexcept = default;
+    Codec(const Codec &) = delete;
+    Codec &operator=(const Codec &) = delete;
+
+    /* Compress in into out and return the compressed size. out must hold
+     * compress_bound(in.size()) bytes, as the compressors do not check
+     * for an output overrun.
+     */
+    std::size_t compress(span<const unsigned char> in, span<unsigned char> out)
+    {
+        lzo_uint out_len = static_cast<lzo_uint>(out.size());
+
+        if (out.size() < compress_bound(in.size()) || !wrkmem_)
+            throw error(wrkmem_ ? LZO_E_OUTPUT_OVERRUN : LZO_E_INVALID_ARGUMENT);
+        int r = traits::compress(const_cast<lzo_bytep>(in.data()), static_cast<lzo_uint>(in.size()),
+                                 out.data(), &out_len, wrkmem_.get());
+        if (r != LZO_E_OK)
+            throw error(r);
+        return out_len;
+    }
+
+    /* Decompress in into out and return the decompressed size. */
+    static std::size_t decompress(span<const unsigned char> in, span<unsigned char> out)
+    {
+        lzo_uint out_len = static_cast<lzo_uint>(out.size());
+
+        int r = detail::decompressor<A>::decompress(const_cast<lzo_bytep>(in.data()), static_cast<lzo_uint>(in.size()),
+                                                    out.data(), &out_len, nullptr);
+        if (r != LZO_E_OK)
+            throw error(r);
+        return out_len;
+    }
+
+private:
+    struct aligned_delete
+    {
+        void operator()(unsigned char *p) const noexcept
+        {
+            ::operator delete(p, std::align_val_t(wrkmem_align));
+        }
+    };
+
+    static unsigned char *allocate_wrkmem()
+    {
+        detail::ensure_init();
+        return static_cast<unsigned char *>(::operator new(wrkmem_size, std::align_val_t(wrkmem_align)));
+    }
+
+    std::unique_ptr<unsigned char, aligned_delete> wrkmem_;
+};
+
+
+/***********************************************************************
+// Streams in the lzopack block format:
+//
+//   magic (7 bytes), flags (4), method (1), level (1), block size (4)
+//   per block: uncompressed size (4), compressed size (4), data
+//   0 (4), adler32 of the uncompressed data (4) if flags bit 0 is set
+//
+// A block that does not get smaller is stored as it is, with both sizes
+// equal. The output can be read by `lzopack -d' and vice versa.
+//
+// write() takes chunks of any size and hands the framed output to a
+// sink, which is called as sink(span<const unsigned char>) and must use
+// the bytes before it returns. All buffers are allocated from the
+// memory_resource when the stream is created (or, for the decompressor,
+// when the first header is seen), so steady state is free of
+// allocations; reset() starts a new stream with the same buffers.
+************************************************************************/
+
+namespace detail {
+
+inline constexpr unsigned char lzopack_magic[7] = { 0x00, 0xe9, 0x4c, 0x5a, 0x4f, 0xff, 0x1a };
+inline constexpr std::size_t lzopack_header_len = 7 + 4 + 1 + 1 + 4;
+inline constexpr std::size_t lzopack_min_block = 1024;
+inline constexpr std::size_t lzopack_max_block = 8L * 1024L * 1024L;
+
+} // namespace detail
+
+
+class StreamCompressor
+{
+public:
+    static constexpr std::size_t default_block_size = 256 * 1024;
+
+    /* level 1 uses LZO1X-1, level 9 LZO1X-999 */
+    explicit StreamCompressor(int level = 1, std::size_t block_size = default_block_size,
+                              std::pmr::memory_resource *mr = std::pmr::get_default_resource())
+        : level_(level), block_size_(block_size)
+    {
+        if ((level != 1 && level != 9) ||
+            block_size < detail::lzopack_min_block || block_size > detail::lzopack_max_block)
+            throw error(LZO_E_INVALID_ARGUMENT, "lzo::StreamCompressor: invalid level or block size");
+        detail::ensure_init();
+        in_ = detail::pmr_buffer(block_size, mr);
+        out_ = detail::pmr_buffer(8 + compress_bound(block_size), mr);
+        wrkmem_ = detail::pmr_buffer(level == 9 ? LZO1X_999_MEM_COMPRESS : LZO1X_1_MEM_COMPRESS, mr);
+        reset();
+    }
+    StreamCompressor(StreamCompressor &&) noexcept = default;
+    StreamCompressor &operator=(StreamCompressor &&) noexcept = default;
+    StreamCompressor(const StreamCompressor &) = delete;
+    StreamCompressor &operator=(const StreamCompressor &) = delete;
+
+    template <class Sink>
+    void write(span<const unsigned char> data, Sink &&sink)
+    {
+        const unsigned char *p = data.data();
+        std::size_t len = data.size();
+
+        start(sink);
+        while (len > 0)
+        {
+            std::size_t n;
+
+            if (fill_ == 0 && len >= block_size_)
+            {
+                /* a whole block, compress it where it is */
+                put_block(p, block_size_, sink);
+                p += block_size_;
+                len -= block_size_;
+                continue;
+            }
+            n = std::min(block_size_ - fill_, len);
+            std::memcpy(in_.data() + fill_, p, n);
+            fill_ += n;
+            p += n;
+            len -= n;
+            if (fill_ == block_size_)
+            {
+                put_block(in_.data(), fill_, sink);
+                fill_ = 0;
+            }
+        }
+    }
+
+    /* write the last block and the end marker */
+    template <class Sink>
+    void finish(Sink &&sink)
+    {
+        start(sink);
+        if (fill_ > 0)
+            put_block(in_.data(), fill_, sink);
+        fill_ = 0;
+        detail::put32(out_.data(), 0);
+        detail::put32(out_.data() + 4, checksum_);
+        sink(span<const unsigned char>(out_.data(), 8));
+        finished_ = true;
+    }
+
+    void reset() noexcept
+    {
+        fill_ = 0;
+        checksum_ = lzo_adler32(0, nullptr, 0);
+        started_ = finished_ = false;
+    }
+
+    std::size_t block_size() const noexcept { return block_size_; }
+
+private:
+    template <class Sink>
+    void start(Sink &sink)
+    {
+        unsigned char *h = out_.data();
+
+        if (finished_)
+            throw error(LZO_E_ERROR, "lzo::StreamCompressor: stream is finished");
+        if (started_)
+            return;
+        std::memcpy(h, detail::lzopack_magic, 7);
+        detail::put32(h + 7, 1);                /* flags: adler32 */
+        h[11] = 1;                              /* method: LZO1X */
+        h[12] = (unsigned char) level_;
+        detail::put32(h + 13, (lzo_uint32_t) block_size_);
+        sink(span<const unsigned char>(h, detail::lzopack_header_len));
+        started_ = true;
+    }
+
+    template <class Sink>
+    void put_block(const unsigned char *p, std::size_t len, Sink &sink)
+    {
+        unsigned char *out = out_.data();
+        lzo_uint out_len = static_cast<lzo_uint>(out_.size() - 8);
+        int r;
+
+        checksum_ = lzo_adler32(checksum_, p, static_cast<lzo_uint>(len));
+        if (level_ == 9)
+            r = lzo1x_999_compress(p, static_cast<lzo_uint>(len), out + 8, &out_len, wrkmem_.data());
+        else
+            r = lzo1x_1_compress(p, static_cast<lzo_uint>(len), out + 8, &out_len, wrkmem_.data());
+        if (r != LZO_E_OK)
+            throw error(r);
+        detail::put32(out, (lzo_uint32_t) len);
+        if (out_len < len)
+        {
+            detail::put32(out + 4, (lzo_uint32_t) out_len);
+            sink(span<const unsigned char>(out, 8 + out_len));
+        }
+        else
+        {
+            /* not compressible, store it */
+            detail::put32(out + 4, (lzo_uint32_t) len);
+            sink(span<const unsigned char>(out, 8));
+            sink(span<const unsigned char>(p, len));
+        }
+    }
+
+    int level_;
+    std::size_t block_size_;
+    std::size_t fill_;
+    lzo_uint32_t checksum_;
+    bool started_;
+    bool finished_;
+    detail::pmr_buffer in_;
+    detail::pmr_buffer out_;
+    detail::pmr_buffer wrkmem_;
+};
+
+
+class StreamDecompressor
+{
+public:
+    explicit StreamDecompressor(std::pmr::memory_resource *mr = std::pmr::get_default_resource())
+        : mr_(mr)
+    {
+        reset();
+    }
+    StreamDecompressor(StreamDecompressor &&) noexcept = default;
+    StreamDecompressor &operator=(StreamDecompressor &&) noexcept = default;
+    StreamDecompressor(const StreamDecompressor &) = delete;
+    StreamDecompressor &operator=(const StreamDecompressor &) = delete;
+
+    template <class Sink>
+    void write(span<const unsigned char> data, Sink &&sink)
+    {
+        const unsigned char *p = data.data();
+        std::size_t len = data.size();
+
+        while (len > 0)
+        {
+            std::size_t n;
+
+            if (state_ == DONE)
+                throw error(LZO_E_INPUT_NOT_CONSUMED, "lzo::StreamDecompressor: data after the end of the stream");
+            if (state_ == BLOCK_DATA)
+            {
+                if (fill_ == 0 && len >= in_len_)
+                {
+                    /* the whole block is at hand, no need to copy it */
+                    put_block(p, sink);
+                    p += in_len_;
+                    len -= in_len_;
+                    continue;
+                }
+                n = std::min(in_len_ - fill_, len);
+                std::memcpy(top() + fill_, p, n);
+                fill_ += n;
+                p += n;
+                len -= n;
+                if (fill_ == in_len_)
+                    put_block(top(), sink);
+                continue;
+            }
+            n = std::min(want_ - fill_, len);
+            std::memcpy(hdr_ + fill_, p, n);
+            fill_ += n;
+            p += n;
+            len -= n;
+            if (fill_ == want_)
+                parse();
+        }
+    }
+
+    /* throw if the stream is not complete */
+    void finish() const
+    {
+        if (state_ != DONE)
+            throw error(LZO_E_INPUT_OVERRUN, "lzo::StreamDecompressor: unexpected end of the stream");
+    }
+
+    bool done() const noexcept { return state_ == DONE; }
+
+    /* start a new stream, keeping the buffer */
+    void reset() noexcept
+    {
+        state_ = HEADER;
+        want_ = detail::lzopack_header_len;
+        fill_ = 0;
+        checksum_ = lzo_adler32(0, nullptr, 0);
+    }
+
+private:
+    enum state_t { HEADER, OUT_LEN, IN_LEN, BLOCK_DATA, CHECKSUM, DONE };
+
+    /* compressed data goes to the top of the buffer and is decompressed
+     * to the bottom, as in lzopack (see overlap.c) */
+    unsigned char *top() const noexcept { return buf_.data() + buf_.size() - in_len_; }
+
+    void expect(state_t state, std::size_t want) noexcept
+    {
+        state_ = state;
+        want_ = want;
+        fill_ = 0;
+    }
+
+    void parse()
+    {
+        switch (state_)
+        {
+        case HEADER:
+            if (std::memcmp(hdr_, detail::lzopack_magic, 7) != 0 || hdr_[11] != 1)
+                throw error(LZO_E_ERROR, "lzo::StreamDecompressor: not an lzopack stream");
+            flags_ = detail::get32(hdr_ + 7);
+            block_size_ = detail::get32(hdr_ + 13);
+            if (block_size_ < detail::lzopack_min_block || block_size_ > detail::lzopack_max_block)
+                throw error(LZO_E_ERROR, "lzo::StreamDecompressor: invalid block size");
+            if (buf_.size() < compress_bound(block_size_))
+                buf_ = detail::pmr_buffer(compress_bound(block_size_), mr_);
+            expect(OUT_LEN, 4);
+            break;
+        case OUT_LEN:
+            out_len_ = detail::get32(hdr_);
+            if (out_len_ == 0)
+                expect((flags_ & 1) ? CHECKSUM : DONE, 4);
+            else
+                expect(IN_LEN, 4);
+            break;
+        case IN_LEN:
+            in_len_ = detail::get32(hdr_);
+            if (in_len_ > block_size_ || out_len_ > block_size_ || in_len_ == 0 || in_len_ > out_len_)
+                throw error(LZO_E_ERROR, "lzo::StreamDecompressor: block size error - data corrupted");
+            expect(BLOCK_DATA, in_len_);
+            break;
+        case CHECKSUM:
+            if (detail::get32(hdr_) != checksum_)
+                throw error(LZO_E_ERROR, "lzo::StreamDecompressor: checksum error - data corrupted");
+            expect(DONE, 0);
+            break;
+        default:
+            break;
+        }
+    }
+
+    template <class Sink>
+    void put_block(const unsigned char *in, Sink &sink)
+    {
+        if (in_len_ < out_len_)
+        {
+            lzo_uint new_len = static_cast<lzo_uint>(out_len_);
+            int r = lzo1x_decompress_safe(in, static_cast<lzo_uint>(in_len_), buf_.data(), &new_len, nullptr);
+
+            if (r != LZO_E_OK || new_len != out_len_)
+                throw error(r != LZO_E_OK ? r : LZO_E_ERROR, "lzo::StreamDecompressor: compressed data violation");
+            in = buf_.data();
+        }
+        checksum_ = lzo_adler32(checksum_, in, static_cast<lzo_uint>(out_len_));
+        expect(OUT_LEN, 4);
+        sink(span<const unsigned char>(in, out_len_));
+    }
+
+    std::pmr::memory_resource *mr_;
+    detail::pmr_buffer buf_;
+    state_t state_;
+    std::size_t want_;
+    std::size_t fill_;
+    std::size_t block_size_ = 0;
+    std::size_t in_len_ = 0;
+    std::size_t out_len_ = 0;
+    lzo_uint32_t flags_ = 0;
+    lzo_uint32_t checksum_;
+    unsigned char hdr_[detail::lzopack_header_len];
+};
+
+} // namespace lzo
+
+#endif /* already included */
+
+
+/* vim:set ts=4 sw=4 et: */
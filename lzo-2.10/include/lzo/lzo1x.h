@@ -63,6 +63,17 @@ lzo1x_decompress_safe   ( const lzo_bytep src, lzo_uint  src_len,
                                 lzo_bytep dst, lzo_uintp dst_len,
                                 lzo_voidp wrkmem /* NOT USED */ );
 
+/* in-place decompression: the src_len bytes of compressed data are at
+ * the end of buf, the uncompressed data is written to its start. buf
+ * needs room for *dst_len plus the margin below, see examples/overlap.c.
+ */
+#define LZO1X_DECOMPRESS_INPLACE_MARGIN(dst_len)    ((dst_len) / 16 + 64 + 3)
+
+LZO_EXTERN(int)
+lzo1x_decompress_inplace ( lzo_bytep buf, lzo_uint  buf_len,
+                           lzo_uint  src_len, lzo_uintp dst_len,
+                           lzo_voidp wrkmem /* NOT USED */ );
+
 
 /***********************************************************************
 //
@@ -113,6 +124,9 @@ lzo1x_1_15_compress     ( const lzo_bytep src, lzo_uint  src_len,
 
 #define LZO1X_999_MEM_COMPRESS  ((lzo_uint32_t) (14 * 16384L * sizeof(short)))
 
+/* compression level 10 (optimal parsing) needs some more work memory */
+#define LZO1X_999_10_MEM_COMPRESS ((lzo_uint32_t) (LZO1X_999_MEM_COMPRESS + 4096L * 104))
+
 LZO_EXTERN(int)
 lzo1x_999_compress      ( const lzo_bytep src, lzo_uint  src_len,
                                 lzo_bytep dst, lzo_uintp dst_len,
@@ -129,6 +143,7 @@ lzo1x_999_compress_dict     ( const lzo_bytep src, lzo_uint  src_len,
                                     lzo_voidp wrkmem,
                               const lzo_bytep dict, lzo_uint dict_len );
 
+/* wrkmem may be NULL if cb has an allocator, see lzo_callback_t */
 LZO_EXTERN(int)
 lzo1x_999_compress_level    ( const lzo_bytep src, lzo_uint  src_len,
                                     lzo_bytep dst, lzo_uintp dst_len,
@@ -144,6 +159,24 @@ lzo1x_decompress_dict_safe ( const lzo_bytep src, lzo_uint  src_len,
                              const lzo_bytep dict, lzo_uint dict_len );
 
 
+/***********************************************************************
+// build a preset dictionary for lzo1x_999_compress_dict() from samples
+************************************************************************/
+
+#define LZO1X_TRAIN_DICT_MEM    ((lzo_uint32_t) (2 * 65536L * sizeof(lzo_uint32_t)))
+
+/* The samples are stored back to back in `samples', the length of each
+ * one is given in `sample_lens'. On entry *dict_len is the size of the
+ * `dict' buffer, on return the number of bytes used. At most 0xbfff bytes
+ * (the LZO1X M4 window) are used.
+ */
+LZO_EXTERN(int)
+lzo1x_train_dict        ( const lzo_bytep samples, const lzo_uint *sample_lens,
+                                lzo_uint nsamples,
+                                lzo_bytep dict, lzo_uintp dict_len,
+                                lzo_voidp wrkmem );
+
+
 /***********************************************************************
 // optimize a compressed data block
 ************************************************************************/
@@ -153,6 +186,44 @@ lzo1x_optimize          (       lzo_bytep src, lzo_uint  src_len,
                                 lzo_bytep dst, lzo_uintp dst_len,
                                 lzo_voidp wrkmem /* NOT USED */ );
 
+/* the same without a scratch buffer: dst holds the uncompressed data,
+ * which must be exactly what src decompresses to, and is only read */
+LZO_EXTERN(int)
+lzo1x_optimize_src      (       lzo_bytep src, lzo_uint  src_len,
+                          const lzo_bytep dst, lzo_uintp dst_len,
+                                lzo_voidp wrkmem /* NOT USED */ );
+
+
+/***********************************************************************
+// match and literal statistics of a compressed data block
+************************************************************************/
+
+#define LZO1X_STATS_LITERAL     0
+#define LZO1X_STATS_M1          1
+#define LZO1X_STATS_M2          2
+#define LZO1X_STATS_M3          3
+#define LZO1X_STATS_M4          4
+
+/* longer matches and literal runs are counted in the last bucket */
+#define LZO1X_STATS_MAX_LEN     256
+
+typedef struct
+{
+    /* indexed by LZO1X_STATS_*: number of codes, uncompressed bytes
+     * they produce and compressed bytes they take, literals included */
+    lzo_uint count[5];
+    lzo_uint bytes[5];
+    lzo_uint code_bytes[5];
+    lzo_uint match_len[LZO1X_STATS_MAX_LEN + 1];
+    lzo_uint literal_run[LZO1X_STATS_MAX_LEN + 1];
+    /* match offsets by bit length, 1 .. 16 */
+    lzo_uint offset_bits[17];
+} lzo1x_stats_t;
+
+/* parses src like lzo1x_decompress_safe() without writing any output */
+LZO_EXTERN(int)
+lzo1x_analyze           ( const lzo_bytep src, lzo_uint  src_len,
+                                lzo1x_stats_t *stats );
 
 
 #ifdef __cplusplus
@@ -80,6 +80,9 @@ lzo1y_1_compress        ( const lzo_bytep src, lzo_uint  src_len,
 
 #define LZO1Y_999_MEM_COMPRESS  ((lzo_uint32_t) (14 * 16384L * sizeof(short)))
 
+/* compression level 10 (optimal parsing) needs some more work memory */
+#define LZO1Y_999_10_MEM_COMPRESS ((lzo_uint32_t) (LZO1Y_999_MEM_COMPRESS + 4096L * 104))
+
 LZO_EXTERN(int)
 lzo1y_999_compress      ( const lzo_bytep src, lzo_uint  src_len,
                                 lzo_bytep dst, lzo_uintp dst_len,
@@ -97,6 +100,7 @@ lzo1y_999_compress_dict     ( const lzo_bytep src, lzo_uint  src_len,
                                     lzo_voidp wrkmem,
                               const lzo_bytep dict, lzo_uint dict_len );
 
+/* wrkmem may be NULL if cb has an allocator, see lzo_callback_t */
 LZO_EXTERN(int)
 lzo1y_999_compress_level    ( const lzo_bytep src, lzo_uint  src_len,
                                     lzo_bytep dst, lzo_uintp dst_len,
@@ -121,6 +125,13 @@ lzo1y_optimize          (       lzo_bytep src, lzo_uint  src_len,
                                 lzo_bytep dst, lzo_uintp dst_len,
                                 lzo_voidp wrkmem /* NOT USED */ );
 
+/* the same without a scratch buffer: dst holds the uncompressed data,
+ * which must be exactly what src decompresses to, and is only read */
+LZO_EXTERN(int)
+lzo1y_optimize_src      (       lzo_bytep src, lzo_uint  src_len,
+                          const lzo_bytep dst, lzo_uintp dst_len,
+                                lzo_voidp wrkmem /* NOT USED */ );
+
 
 
 #ifdef __cplusplus
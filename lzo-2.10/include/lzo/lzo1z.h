@@ -68,6 +68,9 @@ lzo1z_decompress_safe   ( const lzo_bytep src, lzo_uint  src_len,
 
 #define LZO1Z_999_MEM_COMPRESS  ((lzo_uint32_t) (14 * 16384L * sizeof(short)))
 
+/* compression level 10 (optimal parsing) needs some more work memory */
+#define LZO1Z_999_10_MEM_COMPRESS ((lzo_uint32_t) (LZO1Z_999_MEM_COMPRESS + 4096L * 104))
+
 LZO_EXTERN(int)
 lzo1z_999_compress      ( const lzo_bytep src, lzo_uint  src_len,
                                 lzo_bytep dst, lzo_uintp dst_len,
@@ -84,6 +87,7 @@ lzo1z_999_compress_dict     ( const lzo_bytep src, lzo_uint  src_len,
                                     lzo_voidp wrkmem,
                               const lzo_bytep dict, lzo_uint dict_len );
 
+/* wrkmem may be NULL if cb has an allocator, see lzo_callback_t */
 LZO_EXTERN(int)
 lzo1z_999_compress_level    ( const lzo_bytep src, lzo_uint  src_len,
                                     lzo_bytep dst, lzo_uintp dst_len,
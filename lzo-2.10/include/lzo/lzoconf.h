@@ -264,8 +264,7 @@ typedef int
                                      const lzo_bytep dict, lzo_uint dict_len );
 
 
-/* Callback interface. Currently only the progress indicator ("nprogress")
- * is used, but this may change in a future release. */
+/* Callback interface: custom allocators and a progress indicator. */
 
 struct lzo_callback_t;
 typedef struct lzo_callback_t lzo_callback_t;
@@ -283,11 +282,15 @@ typedef void (__LZO_CDECL *lzo_progress_func_t)
 
 struct lzo_callback_t
 {
-    /* custom allocators (set to 0 to disable) */
-    lzo_alloc_func_t nalloc;                /* [not used right now] */
-    lzo_free_func_t nfree;                  /* [not used right now] */
-
-    /* a progress indicator callback function (set to 0 to disable) */
+    /* custom allocators (set to 0 to disable); the 999 compressors of
+     * LZO1X, LZO1Y and LZO1Z take their work memory from nalloc when
+     * they are called with a NULL wrkmem, and return it with nfree */
+    lzo_alloc_func_t nalloc;
+    lzo_free_func_t nfree;
+
+    /* a progress indicator callback function (set to 0 to disable);
+     * the 999 compressors call it about every 1024 bytes of input. If it
+     * sets self->nprogress to 0, they stop and return LZO_E_CANCELLED. */
     lzo_progress_func_t nprogress;
 
     /* INFO: the first parameter "self" of the nalloc/nfree/nprogress
@@ -320,6 +323,7 @@ struct lzo_callback_t
 #define LZO_E_INVALID_ARGUMENT      (-10)
 #define LZO_E_INVALID_ALIGNMENT     (-11)   /* pointer argument is not properly aligned */
 #define LZO_E_OUTPUT_NOT_CONSUMED   (-12)
+#define LZO_E_CANCELLED             (-13)   /* by the progress callback */
 #define LZO_E_INTERNAL_ERROR        (-99)
 
 
@@ -364,6 +368,51 @@ LZO_EXTERN(lzo_uint32_t)
 LZO_EXTERN(const lzo_uint32_tp)
     lzo_get_crc32_table(void);
 
+/* buffer sizes for each algorithm; these return 0 for an unknown method
+ * or level, and lzo_compress_bound() also if the result would overflow */
+#define LZO_METHOD_LZO1         0
+#define LZO_METHOD_LZO1A        1
+#define LZO_METHOD_LZO1B        2
+#define LZO_METHOD_LZO1C        3
+#define LZO_METHOD_LZO1F        4
+#define LZO_METHOD_LZO1X        5
+#define LZO_METHOD_LZO1Y        6
+#define LZO_METHOD_LZO1Z        7
+#define LZO_METHOD_LZO2A        8
+#define LZO_METHOD_ASM_FAST     0x100   /* the _asm_fast decompressors */
+LZO_EXTERN(lzo_uint)
+    lzo_compress_bound(int method, lzo_uint src_len);
+LZO_EXTERN(lzo_uint)
+    lzo_wrkmem_size(int method, int level);
+LZO_EXTERN(lzo_uint)
+    lzo_decompress_overrun(int method);
+
+/* a process-wide pool of pre-faulted work memory, see src/lzo_pool.c;
+ * regions are not cleared, and must be released with the size they
+ * were acquired with */
+#define LZO_WRKMEM_HUGEPAGE     1   /* madvise(MADV_HUGEPAGE) new arenas */
+#define LZO_WRKMEM_PREFAULT     2   /* touch every page of new arenas */
+typedef struct {
+    lzo_uint hits;          /* acquired from an arena */
+    lzo_uint misses;        /* acquired from a new arena */
+    lzo_uint direct;        /* acquired outside the pool */
+    lzo_uint arenas;        /* mapped now */
+    lzo_uint bytes;         /* in those arenas */
+    lzo_uint free;          /* regions in those arenas */
+} lzo_wrkmem_stats_t;
+LZO_EXTERN(lzo_voidp)
+    lzo_wrkmem_acquire(lzo_uint size);
+LZO_EXTERN(void)
+    lzo_wrkmem_release(lzo_voidp wrkmem, lzo_uint size);
+/* flags are LZO_WRKMEM_*, max_bytes limits the size of all arenas */
+LZO_EXTERN(int)
+    lzo_wrkmem_pool(unsigned flags, lzo_uint max_bytes);
+/* unmaps the arenas without a region in use, returns their size */
+LZO_EXTERN(lzo_uint)
+    lzo_wrkmem_trim(void);
+LZO_EXTERN(void)
+    lzo_wrkmem_stats(lzo_wrkmem_stats_t *stats);
+
 /* misc. */
 LZO_EXTERN(int) _lzo_config_check(void);
 typedef union {
@@ -0,0 +1,245 @@
+/* corpus.h -- deterministic synthetic test data for the test driver
+
+   This file is part of the LZO real-time data compression library.
+
+   Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   The LZO library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   The LZO library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the LZO library; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+   http://www.oberhumer.com/opensource/lzo/
+ */
+
+
+/*************************************************************************
+// The same seed and size always give the same bytes, on every machine
+// and in tests/corpus.py of the Python bindings, which must be kept in
+// sync with this file. Every random choice is made in a fixed order
+// from one splitmix64 stream per generator.
+**************************************************************************/
+
+#define CORPUS_TEXT     0       /* order-1 word Markov chain */
+#define CORPUS_JSON     1       /* JSON-like log lines */
+#define CORPUS_NUMERIC  2       /* binary rows of numeric columns */
+#define CORPUS_RANDOM   3
+#define CORPUS_ZEROS    4
+#define CORPUS_MIXED    5       /* 64 KiB chunks of the kinds above */
+#define CORPUS_KINDS    6
+
+static const char * const corpus_kinds[CORPUS_KINDS] = {
+    "text", "json", "numeric", "random", "zeros", "mixed"
+};
+
+typedef struct {
+    lzo_bytep ptr;
+    lzo_uint len;
+    lzo_uint pos;
+    lzo_uint64_t state;
+} corpus_t;
+
+
+static lzo_uint64_t corpus_next(corpus_t *g)
+{
+    lzo_uint64_t z;
+
+    g->state += LZO_UINT64_C(0x9e3779b97f4a7c15);
+    z = g->state;
+    z = (z ^ (z >> 30)) * LZO_UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * LZO_UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+/* a number in [0, n) */
+static unsigned corpus_rand(corpus_t *g, unsigned n)
+{
+    return (unsigned) (corpus_next(g) % n);
+}
+
+static void corpus_put(corpus_t *g, const void *p, lzo_uint n)
+{
+    if (n > g->len - g->pos)
+        n = g->len - g->pos;
+    lzo_memcpy(g->ptr + g->pos, p, n);
+    g->pos += n;
+}
+
+static void corpus_put_le(corpus_t *g, lzo_uint64_t v, unsigned n)
+{
+    unsigned char b[8];
+    unsigned i;
+
+    for (i = 0; i < n; i++, v >>= 8)
+        b[i] = (unsigned char) (v & 0xff);
+    corpus_put(g, b, n);
+}
+
+
+static void corpus_text(corpus_t *g)
+{
+    static const char letters[] = "etaoinshrdlucmfwypvbgkjqxz";
+    char vocab[256][10];
+    unsigned w, prev = 0, words = 0, sentence, line = 0;
+
+    /* the vocabulary, with common letters more likely */
+    for (w = 0; w < 256; w++)
+    {
+        unsigned i, n = 2 + corpus_rand(g, 8);
+        for (i = 0; i < n; i++)
+        {
+            unsigned a = corpus_rand(g, 26);
+            unsigned b = corpus_rand(g, 26);
+            vocab[w][i] = letters[a < b ? a : b];
+        }
+        vocab[w][n] = 0;
+    }
+
+    sentence = 4 + corpus_rand(g, 12);
+    while (g->pos < g->len)
+    {
+        lzo_uint n;
+
+        if (corpus_rand(g, 4) != 0)
+            w = (prev * 31 + corpus_rand(g, 8)) % 256;
+        else
+        {
+            unsigned t = corpus_rand(g, 256) + 1;
+            w = corpus_rand(g, t);
+        }
+        prev = w;
+        n = strlen(vocab[w]);
+        corpus_put(g, vocab[w], n);
+        line += (unsigned) n + 1;
+        if (++words >= sentence)
+        {
+            corpus_put(g, ".", 1);
+            line += 1;
+            words = 0;
+            sentence = 4 + corpus_rand(g, 12);
+        }
+        if (line >= 72)
+        {
+            corpus_put(g, "\n", 1);
+            line = 0;
+        }
+        else
+            corpus_put(g, " ", 1);
+    }
+}
+
+
+static void corpus_json(corpus_t *g)
+{
+    static const char * const paths[5] = { "users", "items", "orders", "search", "health" };
+    lzo_uint64_t ts = LZO_UINT64_C(1700000000000);
+    char buf[256];
+
+    while (g->pos < g->len)
+    {
+        unsigned l, host, req, path, id, s, status, t, ms;
+        const char *level;
+
+        ts += corpus_rand(g, 50);
+        l = corpus_rand(g, 16);
+        level = l == 0 ? "ERROR" : l < 3 ? "WARN" : l < 6 ? "DEBUG" : "INFO";
+        host = corpus_rand(g, 16);
+        req = (unsigned) (corpus_next(g) & 0xffffffffu);
+        path = corpus_rand(g, 5);
+        id = corpus_rand(g, 10000);
+        s = corpus_rand(g, 20);
+        status = s == 0 ? 500 : s == 1 ? 404 : s == 2 ? 302 : 200;
+        t = corpus_rand(g, 1000) + 1;
+        ms = corpus_rand(g, t);
+        sprintf(buf, "{\"ts\":%lu%03u,\"level\":\"%s\",\"host\":\"web-%02u\",\"req\":\"%08x\","
+                "\"path\":\"/api/v1/%s/%u\",\"status\":%u,\"ms\":%u}\n",
+                (unsigned long) (ts / 1000), (unsigned) (ts % 1000), level, host, req,
+                paths[path], id, status, ms);
+        corpus_put(g, buf, strlen(buf));
+    }
+}
+
+
+static void corpus_numeric(corpus_t *g)
+{
+    lzo_uint64_t ts = LZO_UINT64_C(1700000000000000);
+    lzo_uint32_t v = 0;
+
+    /* u64 timestamp, i32 random walk, u16 category, u16 rare flag */
+    while (g->pos < g->len)
+    {
+        ts += 1000 + corpus_rand(g, 10);
+        v += (lzo_uint32_t) corpus_rand(g, 201) - 100;
+        corpus_put_le(g, ts, 8);
+        corpus_put_le(g, v, 4);
+        corpus_put_le(g, corpus_rand(g, 8), 2);
+        corpus_put_le(g, corpus_rand(g, 64) == 0, 2);
+    }
+}
+
+
+static void corpus_generate(int kind, lzo_bytep out, lzo_uint len, lzo_uint64_t seed)
+{
+    corpus_t g;
+
+    g.ptr = out;
+    g.len = len;
+    g.pos = 0;
+    g.state = seed;
+
+    switch (kind)
+    {
+    case CORPUS_TEXT:
+        corpus_text(&g);
+        break;
+    case CORPUS_JSON:
+        corpus_json(&g);
+        break;
+    case CORPUS_NUMERIC:
+        corpus_numeric(&g);
+        break;
+    case CORPUS_RANDOM:
+        while (g.pos < g.len)
+            corpus_put_le(&g, corpus_next(&g), 8);
+        break;
+    case CORPUS_ZEROS:
+        lzo_memset(out, 0, len);
+        break;
+    case CORPUS_MIXED:
+        while (g.pos < g.len)
+        {
+            lzo_uint n = g.len - g.pos < 65536 ? g.len - g.pos : 65536;
+            int k = (int) corpus_rand(&g, CORPUS_MIXED);
+            corpus_generate(k, g.ptr + g.pos, n, corpus_next(&g));
+            g.pos += n;
+        }
+        break;
+    }
+}
+
+
+static int corpus_find(const char *name)
+{
+    int k;
+
+    for (k = 0; k < CORPUS_KINDS; k++)
+        if (strcmp(name, corpus_kinds[k]) == 0)
+            return k;
+    return -1;
+}
+
+
+/* vim:set ts=4 sw=4 et: */
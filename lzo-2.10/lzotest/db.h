@@ -307,6 +307,12 @@
   lzo1x_decompress_asm,         lzo1x_decompress_asm_safe,
   lzo1x_decompress_asm_fast,    lzo1x_decompress_asm_fast_safe,
   0,                            lzo1x_decompress_dict_safe },
+{ "LZO1X-999/10", 97210, LZO1X_999_10_MEM_COMPRESS, LZO1X_MEM_DECOMPRESS,
+  lzo1x_999_10_compress,        lzo1x_optimize,
+  lzo1x_decompress,             lzo1x_decompress_safe,
+  lzo1x_decompress_asm,         lzo1x_decompress_asm_safe,
+  lzo1x_decompress_asm_fast,    lzo1x_decompress_asm_fast_safe,
+  0,                            lzo1x_decompress_dict_safe },
 #endif
 
 #if defined(HAVE_LZO1Y_H)
@@ -376,6 +382,12 @@
   lzo1y_decompress_asm,         lzo1y_decompress_asm_safe,
   lzo1y_decompress_asm_fast,    lzo1y_decompress_asm_fast_safe,
   0,                            lzo1y_decompress_dict_safe },
+{ "LZO1Y-999/10", 98210, LZO1Y_999_10_MEM_COMPRESS, LZO1Y_MEM_DECOMPRESS,
+  lzo1y_999_10_compress,        lzo1y_optimize,
+  lzo1y_decompress,             lzo1y_decompress_safe,
+  lzo1y_decompress_asm,         lzo1y_decompress_asm_safe,
+  lzo1y_decompress_asm_fast,    lzo1y_decompress_asm_fast_safe,
+  0,                            lzo1y_decompress_dict_safe },
 #endif
 
 #if defined(HAVE_LZO1Z_H)
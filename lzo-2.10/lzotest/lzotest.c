@@ -38,6 +38,7 @@
 #define WANT_LZO_FREAD 1
 #define WANT_LZO_WILDARGV 1
 #define WANT_LZO_PCLOCK 1
+#define LZO_WANT_ACCLIB_RDTSC 1
 #define LZO_WANT_ACCLIB_GETOPT 1
 #include "examples/portab.h"
 
@@ -128,6 +129,17 @@
 #  include <bzlib.h>
 #  define ALG_BZIP2 1
 #endif
+/* the --threads scaling benchmark */
+#if defined(HAVE_PTHREAD_H)
+#  include <pthread.h>
+#endif
+/* the --perf hardware counters */
+#if defined(HAVE_LINUX_PERF_EVENT_H)
+#  include <linux/perf_event.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#  include <errno.h>
+#endif
 
 
 /*************************************************************************
@@ -233,6 +245,19 @@ static lzo_uint32_t crc_in, crc_out;
 lzo_bool opt_execution_time = 0;
 int opt_pclock = -1;
 lzo_bool opt_clear_wrkmem = 0;
+int opt_threads = 0;
+lzo_bool opt_threads_shared = 0;
+
+/* --format and --compare */
+#define FORMAT_TEXT     0
+#define FORMAT_JSON     1
+#define FORMAT_CSV      2
+int opt_format = FORMAT_TEXT;
+const char *opt_compare_file = NULL;
+double opt_compare_threshold = 5.0;     /* percent */
+lzo_bool opt_perf = 0;
+lzo_uint opt_synthetic_size = 0;
+lzo_uint64_t opt_seed = 0;
 
 static const lzo_bool opt_try_to_compress_0_bytes = 1;
 
@@ -313,6 +338,7 @@ static const int x999_methods[] = {
 #define EXIT_LZO_ERROR  5
 #define EXIT_LZO_INIT   6
 #define EXIT_INTERNAL   7
+#define EXIT_REGRESSION 8
 
 
 /*************************************************************************
@@ -827,6 +853,526 @@ static int load_file(const char *file_name, lzo_uint max_data_len)
 }
 
 
+/***********************************************************************
+// generate a synthetic file, see corpus.h
+************************************************************************/
+
+#include "corpus.h"
+
+#define SYNTHETIC_PREFIX    "synthetic:"
+
+/* file names "synthetic:KIND" are generated instead of read */
+static int load_data(const char *file_name, lzo_uint max_data_len)
+{
+    size_t n = strlen(SYNTHETIC_PREFIX);
+    lzo_uint len = opt_synthetic_size > 0 ? opt_synthetic_size : 1024 * 1024L;
+    int kind;
+
+    if (strncmp(file_name, SYNTHETIC_PREFIX, n) != 0)
+        return load_file(file_name, max_data_len);
+    kind = corpus_find(file_name + n);
+    if (kind < 0)
+    {
+        fprintf(stderr, "%s: unknown synthetic corpus kind\n", file_name);
+        return EXIT_FILE;
+    }
+    if (len > max_data_len)
+        len = max_data_len;
+    mb_free(&file_data);
+    mb_alloc(&file_data, len);
+    corpus_generate(kind, file_data.ptr, len, opt_seed);
+    return EXIT_OK;
+}
+
+
+/***********************************************************************
+// hardware performance counters (--perf, Linux perf_event_open)
+//
+// The counters of one group are read before and after every timed loop
+// and the differences are summed per phase. Only user space is counted,
+// which also works with perf_event_paranoid=2. Events the CPU or the
+// hypervisor does not provide are reported as not available.
+************************************************************************/
+
+#define PERF_COMPRESS       0
+#define PERF_DECOMPRESS     1
+#define PERF_OPTIMIZE       2
+#define PERF_PHASES         3
+
+#define PERF_CYCLES         0
+#define PERF_INSTRUCTIONS   1
+#define PERF_EVENTS         6
+
+static const char * const perf_phase_names[PERF_PHASES] = {
+    "compress", "decompress", "optimize"
+};
+static const char * const perf_event_names[PERF_EVENTS] = {
+    "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses", "task_clock_ns"
+};
+
+typedef struct {
+    double v[PERF_EVENTS];
+    double bytes;
+} perf_phase_t;
+
+static perf_phase_t perf_phase[PERF_PHASES];
+static lzo_bool perf_valid = 0;     /* perf_phase[] belongs to this file */
+
+#if defined(HAVE_LINUX_PERF_EVENT_H)
+
+static int perf_fd[PERF_EVENTS];
+static int perf_slot[PERF_EVENTS];  /* position in the group read */
+static int perf_leader = -1;
+static int perf_n = 0;
+static double perf_start[PERF_EVENTS];
+
+
+static lzo_bool perf_open(void)
+{
+    static const struct { lzo_uint32_t type; lzo_uint64_t config; } ev[PERF_EVENTS] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    };
+    struct perf_event_attr attr;
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++)
+    {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = ev[i].type;
+        attr.config = ev[i].config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        perf_fd[i] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, perf_leader, 0);
+        perf_slot[i] = -1;
+        if (perf_fd[i] < 0)
+            continue;
+        if (perf_leader < 0)
+            perf_leader = perf_fd[i];
+        perf_slot[i] = perf_n++;
+    }
+    if (perf_n == 0)
+        fprintf(stderr, "%s: perf_event_open failed: %s\n", progname, strerror(errno));
+    else if (perf_fd[PERF_CYCLES] < 0)
+        fprintf(stderr, "%s: no hardware counters available\n", progname);
+    return perf_n > 0;
+}
+
+
+static void perf_read(double *v)
+{
+    lzo_uint64_t buf[1 + PERF_EVENTS];
+    int i;
+
+    if (read(perf_leader, buf, sizeof(buf)) < (long) sizeof(lzo_uint64_t) || buf[0] != (lzo_uint64_t) perf_n)
+        buf[0] = 0;
+    for (i = 0; i < PERF_EVENTS; i++)
+        v[i] = (buf[0] > 0 && perf_slot[i] >= 0) ? (double) buf[1 + perf_slot[i]] : -1;
+}
+
+
+static void perf_begin(void)
+{
+    if (opt_perf)
+        perf_read(perf_start);
+}
+
+
+static void perf_end(int phase, double bytes)
+{
+    double v[PERF_EVENTS];
+    int i;
+
+    if (!opt_perf)
+        return;
+    perf_read(v);
+    for (i = 0; i < PERF_EVENTS; i++)
+    {
+        if (v[i] < 0 || perf_start[i] < 0 || perf_phase[phase].v[i] < 0)
+            perf_phase[phase].v[i] = -1;
+        else
+            perf_phase[phase].v[i] += v[i] - perf_start[i];
+    }
+    perf_phase[phase].bytes += bytes;
+}
+
+#else
+
+static lzo_bool perf_open(void)
+{
+    fprintf(stderr, "%s: this build does not support --perf\n", progname);
+    return 0;
+}
+
+#define perf_begin()        ((void) 0)
+#define perf_end(p,b)       ((void) 0)
+
+#endif /* HAVE_LINUX_PERF_EVENT_H */
+
+
+static void perf_reset(lzo_bool valid)
+{
+    memset(perf_phase, 0, sizeof(perf_phase));
+    perf_valid = valid && opt_perf;
+}
+
+
+static double perf_get(int phase, int event)
+{
+    if (!perf_valid || perf_phase[phase].bytes <= 0)
+        return -1;
+    return perf_phase[phase].v[event];
+}
+
+
+static double perf_ipc(int phase)
+{
+    double c = perf_get(phase, PERF_CYCLES);
+    double i = perf_get(phase, PERF_INSTRUCTIONS);
+    return (c > 0 && i >= 0) ? i / c : -1;
+}
+
+
+/* verbose text output: per byte, so that files and loop counts compare */
+static void perf_print(void)
+{
+    int p, e;
+
+    if (!perf_valid)
+        return;
+    for (p = 0; p < PERF_PHASES; p++)
+    {
+        if (perf_phase[p].bytes <= 0)
+            continue;
+        printf("  perf %-10s IPC ", perf_phase_names[p]);
+        if (perf_ipc(p) >= 0)
+            printf("%.2f", perf_ipc(p));
+        else
+            printf("n/a");
+        for (e = 0; e < PERF_EVENTS; e++)
+        {
+            double v = perf_get(p, e);
+            if (v >= 0)
+                printf(", %s/byte %.4f", perf_event_names[e], v / perf_phase[p].bytes);
+        }
+        printf("\n");
+    }
+}
+
+
+/***********************************************************************
+// machine-readable results (--format) and baseline comparison (--compare)
+************************************************************************/
+
+typedef struct {
+    char method[32];
+    char file[64];
+    int threads;
+    double c_mbs, d_mbs;
+} baseline_t;
+
+static baseline_t *baseline = NULL;
+static unsigned long baseline_n = 0;
+static unsigned long results_n = 0;
+static unsigned long regressions_n = 0;
+
+
+/* TSC ticks, or 0 if there is no time stamp counter */
+static double tsc_read(void)
+{
+#if defined(__LZOLIB_RDTSC_CH_INCLUDED) && defined(lzo_int32e_t)
+    lzo_uint32e_t t[2];
+    if (lzo_tsc_read(t) == 0)
+        return t[1] * 4294967296.0 + t[0];
+#endif
+    return 0;
+}
+
+
+static const char *file_basename(const char *file_name)
+{
+    const char *n, *b;
+    for (n = b = file_name; *n; n++)
+        if (*n == '/' || *n == '\\' || *n == ':')
+            b = n + 1;
+    return b;
+}
+
+
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for ( ; *s; s++)
+    {
+        unsigned char ch = (unsigned char) *s;
+        if (ch == '"' || ch == '\\')
+            printf("\\%c", ch);
+        else if (ch < 0x20)
+            printf("\\u%04x", ch);
+        else
+            putchar(ch);
+    }
+    putchar('"');
+}
+
+
+static void print_csv_string(const char *s)
+{
+    if (strpbrk(s, ",\"\r\n") == NULL) {
+        fputs(s, stdout);
+        return;
+    }
+    putchar('"');
+    for ( ; *s; s++)
+    {
+        if (*s == '"')
+            putchar('"');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+
+/* find "key": in a line written by print_result() */
+static const char *json_find(const char *line, const char *key)
+{
+    char k[32+4];
+    const char *p;
+
+    sprintf(k, "\"%s\":", key);
+    p = strstr(line, k);
+    if (p == NULL)
+        return NULL;
+    p += strlen(k);
+    while (is_space(*p))
+        p++;
+    return p;
+}
+
+static lzo_bool json_get_string(const char *line, const char *key, char *buf, size_t size)
+{
+    const char *p = json_find(line, key);
+    size_t i = 0;
+
+    if (p == NULL || *p++ != '"')
+        return 0;
+    for ( ; *p && *p != '"' && i + 1 < size; p++)
+    {
+        if (*p == '\\' && p[1])
+            p++;
+        buf[i++] = *p;
+    }
+    buf[i] = 0;
+    return 1;
+}
+
+static double json_get_number(const char *line, const char *key)
+{
+    const char *p = json_find(line, key);
+    return (p && (is_digit(*p) || *p == '-')) ? atof(p) : 0;
+}
+
+
+/* read the rows of a previous --format=json run */
+static int baseline_load(const char *file_name)
+{
+    FILE *fp;
+    char line[4096];
+    unsigned long n = 0;
+
+    fp = fopen(file_name, "r");
+    if (fp == NULL)
+    {
+        printf("%s: cannot open baseline file %s\n", progname, file_name);
+        return EXIT_FILE;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL)
+        if (json_find(line, "method") != NULL)
+            n++;
+    baseline = (baseline_t *) lzo_malloc((n > 0 ? n : 1) * sizeof(baseline_t));
+    if (baseline == NULL)
+    {
+        (void) fclose(fp);
+        return EXIT_MEM;
+    }
+    rewind(fp);
+    while (baseline_n < n && fgets(line, sizeof(line), fp) != NULL)
+    {
+        baseline_t *b = &baseline[baseline_n];
+        char file[1024];
+
+        if (!json_get_string(line, "method", b->method, sizeof(b->method)))
+            continue;
+        if (!json_get_string(line, "file", file, sizeof(file)))
+            continue;
+        strncpy(b->file, file_basename(file), sizeof(b->file) - 1);
+        b->file[sizeof(b->file) - 1] = 0;
+        b->threads = (int) json_get_number(line, "threads");
+        b->c_mbs = json_get_number(line, "compress_mbs");
+        b->d_mbs = json_get_number(line, "decompress_mbs");
+        baseline_n++;
+    }
+    (void) fclose(fp);
+    return EXIT_OK;
+}
+
+
+/* report a speed that dropped by more than --compare-threshold percent */
+static lzo_bool check_regression(const char *what, const char *method_name,
+                                 const char *file_name, double base, double now)
+{
+    FILE *fp = opt_format == FORMAT_TEXT ? stdout : stderr;
+    double change;
+
+    if (base <= 0 || now <= 0)
+        return 0;
+    change = (now - base) * 100.0 / base;
+    if (change >= -opt_compare_threshold)
+        return 0;
+    fprintf(fp, "  REGRESSION: %s %s %s %.3f -> %.3f MB/sec (%.1f%%)\n",
+            method_name, file_name, what, base, now, change);
+    return 1;
+}
+
+static lzo_bool compare_result(const char *method_name, const char *file_name,
+                               int threads, double c_mbs, double d_mbs)
+{
+    unsigned long i;
+    lzo_bool r;
+
+    for (i = 0; i < baseline_n; i++)
+    {
+        const baseline_t *b = &baseline[i];
+        if (b->threads != threads || strcmp(b->method, method_name) != 0 ||
+            strcmp(b->file, file_name) != 0)
+            continue;
+        r = check_regression("compress", method_name, file_name, b->c_mbs, c_mbs);
+        r |= check_regression("decompress", method_name, file_name, b->d_mbs, d_mbs);
+        if (r)
+            regressions_n++;
+        return r;
+    }
+    return 0;
+}
+
+
+/* one row per method and file; cycles/byte are TSC ticks per byte */
+static void print_result(const char *method_name, const char *file_name,
+                         int threads, unsigned long d_len, unsigned long blocks,
+                         unsigned long c_len, double c_mbs, double d_mbs,
+                         double c_cpb, double d_cpb)
+{
+    const char *b = file_basename(file_name);
+    double ratio = d_len > 0 ? (double) c_len / d_len : 0;
+    lzo_bool regression = 0;
+
+    if (baseline != NULL)
+        regression = compare_result(method_name, b, threads, c_mbs, d_mbs);
+
+    if (opt_format == FORMAT_JSON)
+    {
+        printf("%s  {\"method\": ", results_n == 0 ? "[\n" : ",\n");
+        print_json_string(method_name);
+        printf(", \"file\": ");
+        print_json_string(file_name);
+        printf(", \"threads\": %d, \"length\": %lu, \"blocks\": %lu, \"compressed\": %lu, \"ratio\": %.6f",
+               threads, d_len, blocks, c_len, ratio);
+        printf(", \"compress_mbs\": %.3f, \"decompress_mbs\": %.3f", c_mbs, d_mbs);
+        if (c_cpb > 0 && d_cpb > 0)
+            printf(", \"compress_cpb\": %.3f, \"decompress_cpb\": %.3f", c_cpb, d_cpb);
+        else
+            printf(", \"compress_cpb\": null, \"decompress_cpb\": null");
+        printf(", \"adler32\": \"0x%08lx\", \"crc32\": \"0x%08lx\", \"verified\": true",
+               (unsigned long) file_data.adler, (unsigned long) file_data.crc);
+        if (baseline != NULL)
+            printf(", \"regression\": %s", regression ? "true" : "false");
+        if (opt_perf)
+        {
+            int p, e;
+            for (p = 0; p < PERF_PHASES; p++)
+            {
+                printf("%s\"%s\": {", p == 0 ? ", \"perf\": {" : ", ", perf_phase_names[p]);
+                for (e = 0; e < PERF_EVENTS; e++)
+                {
+                    if (perf_get(p, e) >= 0)
+                        printf("\"%s\": %.0f, ", perf_event_names[e], perf_get(p, e));
+                    else
+                        printf("\"%s\": null, ", perf_event_names[e]);
+                }
+                if (perf_ipc(p) >= 0)
+                    printf("\"ipc\": %.3f}", perf_ipc(p));
+                else
+                    printf("\"ipc\": null}");
+            }
+            printf("}");
+        }
+        printf("}");
+    }
+    else if (opt_format == FORMAT_CSV)
+    {
+        int p, e;
+
+        if (results_n == 0)
+        {
+            printf("method,file,threads,length,blocks,compressed,ratio,compress_mbs,decompress_mbs,"
+                   "compress_cpb,decompress_cpb,adler32,crc32,verified%s",
+                   baseline != NULL ? ",regression" : "");
+            for (p = 0; opt_perf && p < PERF_PHASES; p++)
+            {
+                for (e = 0; e < PERF_EVENTS; e++)
+                    printf(",%s_%s", perf_phase_names[p], perf_event_names[e]);
+                printf(",%s_ipc", perf_phase_names[p]);
+            }
+            printf("\n");
+        }
+        print_csv_string(method_name);
+        putchar(',');
+        print_csv_string(file_name);
+        printf(",%d,%lu,%lu,%lu,%.6f,%.3f,%.3f,", threads, d_len, blocks, c_len, ratio, c_mbs, d_mbs);
+        if (c_cpb > 0 && d_cpb > 0)
+            printf("%.3f,%.3f", c_cpb, d_cpb);
+        else
+            printf(",");
+        printf(",0x%08lx,0x%08lx,1", (unsigned long) file_data.adler, (unsigned long) file_data.crc);
+        if (baseline != NULL)
+            printf(",%d", regression ? 1 : 0);
+        for (p = 0; opt_perf && p < PERF_PHASES; p++)
+        {
+            for (e = 0; e < PERF_EVENTS; e++)
+            {
+                if (perf_get(p, e) >= 0)
+                    printf(",%.0f", perf_get(p, e));
+                else
+                    printf(",");
+            }
+            if (perf_ipc(p) >= 0)
+                printf(",%.3f", perf_ipc(p));
+            else
+                printf(",");
+        }
+        printf("\n");
+    }
+    results_n++;
+}
+
+
+/* close the JSON array */
+static void print_results_end(void)
+{
+    if (opt_format == FORMAT_JSON)
+        printf("%s]\n", results_n == 0 ? "[\n" : "\n");
+    fflush(stdout);
+}
+
+
 /***********************************************************************
 // print some compression statistics
 ************************************************************************/
@@ -870,6 +1416,7 @@ static
 void print_stats ( const char *method_name, const char *file_name,
                    long t_loops, long c_loops, long d_loops,
                    double t_secs, double c_secs, double d_secs,
+                   double c_ticks, double d_ticks,
                    unsigned long c_len, unsigned long d_len,
                    unsigned long blocks )
 {
@@ -893,6 +1440,9 @@ void print_stats ( const char *method_name, const char *file_name,
     d_mbs = (d_secs > 0.001) ? (d_bytes / d_secs) / 1000000.0 : 0;
     t_mbs = (t_secs > 0.001) ? (t_bytes / t_secs) / 1000000.0 : 0;
 
+    print_result(method_name, file_name, 1, d_len, blocks, c_len, c_mbs, d_mbs,
+                 c_bytes > 0 ? c_ticks / c_bytes : 0, d_bytes > 0 ? d_ticks / d_bytes : 0);
+
     total_n++;
     total_c_len += c_len;
     total_d_len += d_len;
@@ -927,6 +1477,7 @@ void print_stats ( const char *method_name, const char *file_name,
         printf("%-15s %5ld: ","decompress", d_loops);
         printf("%10lu bytes, %8.2f secs, %8.3f MB/sec\n",
                d_bytes, d_secs, d_mbs);
+        perf_print();
         printf("\n");
     }
 
@@ -999,6 +1550,7 @@ int process_file ( const compress_t *c, lzo_decompress_t decompress,
     unsigned long blocks = 0;
     unsigned long compressed_len = 0;
     double t_time = 0, c_time = 0, d_time = 0;
+    double c_ticks = 0, d_ticks = 0, x_ticks;
     lzo_pclock_t t_start, t_stop, x_start, x_stop;
     FILE *fp_dump = NULL;
 
@@ -1007,6 +1559,7 @@ int process_file ( const compress_t *c, lzo_decompress_t decompress,
 
 /* process the file */
 
+    perf_reset(1);
     lzo_pclock_flush_cpu_cache(&pch, 0);
     lzo_pclock_read(&pch, &t_start);
     for (t_i = 0; t_i < t_loops; t_i++)
@@ -1050,7 +1603,9 @@ int process_file ( const compress_t *c, lzo_decompress_t decompress,
         /* compress the block */
             c_len = c_len_max = 0;
             lzo_pclock_flush_cpu_cache(&pch, 0);
+            perf_begin();
             lzo_pclock_read(&pch, &x_start);
+            x_ticks = tsc_read();
             for (r = 0, c_i = 0; c_i < c_loops; c_i++)
             {
                 c_len = block_c.len;
@@ -1062,7 +1617,9 @@ int process_file ( const compress_t *c, lzo_decompress_t decompress,
                 if (c_len > block_c.len)
                     goto compress_overrun;
             }
+            c_ticks += tsc_read() - x_ticks;
             lzo_pclock_read(&pch, &x_stop);
+            perf_end(PERF_COMPRESS, (double) bl * c_loops);
             c_time += lzo_pclock_get_elapsed(&pch, &x_start, &x_stop);
             if (r != 0)
             {
@@ -1083,7 +1640,9 @@ compress_overrun:
             if (c_len < bl && opt_optimize_compressed_data)
             {
                 d_len = bl;
+                perf_begin();
                 r = call_optimizer(c, block_c.ptr, c_len, block_d.ptr, &d_len);
+                perf_end(PERF_OPTIMIZE, (double) bl);
                 if (r != 0 || d_len != bl)
                 {
                     printf("  optimization failed in block %lu (%d) "
@@ -1113,7 +1672,9 @@ compress_overrun:
 
         /* decompress the block and verify */
             lzo_pclock_flush_cpu_cache(&pch, 0);
+            perf_begin();
             lzo_pclock_read(&pch, &x_start);
+            x_ticks = tsc_read();
             for (r = 0, c_i = 0; c_i < d_loops; c_i++)
             {
                 d_len = bl;
@@ -1121,7 +1682,9 @@ compress_overrun:
                 if (r != 0 || d_len != bl)
                     break;
             }
+            d_ticks += tsc_read() - x_ticks;
             lzo_pclock_read(&pch, &x_stop);
+            perf_end(PERF_DECOMPRESS, (double) bl * d_loops);
             d_time += lzo_pclock_get_elapsed(&pch, &x_start, &x_stop);
             if (r != 0)
             {
@@ -1206,6 +1769,7 @@ compress_overrun:
     print_stats(method_name, file_name,
                 t_loops, c_loops, d_loops,
                 t_time, c_time, d_time,
+                c_ticks, d_ticks,
                 compressed_len, (unsigned long) file_data.len, blocks);
     if (total_method_name != c->name) {
         total_method_name = c->name;
@@ -1217,6 +1781,302 @@ compress_overrun:
 
 
 
+/*************************************************************************
+// multi-threaded scaling benchmark (--threads=N)
+//
+// Every thread owns its wrkmem and output buffers and runs the method
+// over the whole file; with --threads-input=disjoint it also works on a
+// private copy of the input. Each phase is one round of pthread_create()
+// and pthread_join(), so the joins double as the barrier between the
+// (untimed) setup, compress and decompress phases.
+**************************************************************************/
+
+#if defined(HAVE_PTHREAD_H)
+
+typedef struct {
+    const compress_t *c;
+    lzo_decompress_t decompress;
+    long c_loops, d_loops;
+    int phase;
+    const lzo_bytep in;         /* file_data.ptr or copy.ptr */
+    mblock_t copy;              /* private input for --threads-input=disjoint */
+    mblock_t out_c;             /* all compressed blocks, back to back */
+    mblock_t out_d;
+    mblock_t wrkmem;
+    lzo_uint *c_lens;
+    unsigned long blocks;
+    unsigned long c_len;
+    double c_secs, d_secs;
+    int r;
+    lzo_pclock_handle_t h;
+} mt_bench_t;
+
+
+static void *mt_bench_thread(void *arg)
+{
+    mt_bench_t *t = (mt_bench_t *) arg;
+    const compress_t *c = t->c;
+    const lzo_uint len = file_data.len;
+    lzo_pclock_t x_start, x_stop;
+    lzo_bytep p;
+    lzo_uint off;
+    unsigned long b;
+    long i;
+    int r = 0;
+
+    switch (t->phase)
+    {
+    case 0:
+        /* allocate from the thread itself so first-touch places the pages */
+        t->in = file_data.ptr;
+        if (!opt_threads_shared)
+        {
+            mb_alloc(&t->copy, len);
+            lzo_memcpy(t->copy.ptr, file_data.ptr, len);
+            t->in = t->copy.ptr;
+        }
+        t->blocks = len > 0 ? (unsigned long) ((len - 1) / opt_block_size + 1) : 1;
+        mb_alloc(&t->out_c, len + t->blocks * get_max_compression_expansion(c->id, opt_block_size));
+        mb_alloc(&t->out_d, len + get_max_decompression_overrun(c->id, len));
+        mb_alloc_extra(&t->wrkmem, block_w.len, 0, 64);
+        t->wrkmem.ptr = LZO_PTR_ALIGN_UP(t->wrkmem.alloc_ptr, 64);
+        lzo_memset(t->out_c.ptr, 0, t->out_c.len);
+        lzo_memset(t->out_d.ptr, 0, t->out_d.len);
+        lzo_memset(t->wrkmem.ptr, 0, block_w.len);
+        t->c_lens = (lzo_uint *) lzo_malloc(t->blocks * sizeof(lzo_uint));
+        if (t->c_lens == NULL)
+            t->r = EXIT_MEM;
+        break;
+
+    case 1:
+        t->c_len = 0;
+        lzo_pclock_read(&t->h, &x_start);
+        for (b = 0, off = 0, p = t->out_c.ptr; b < t->blocks && r == 0; b++)
+        {
+            lzo_uint bl = len - off > opt_block_size ? opt_block_size : len - off;
+            lzo_uint c_len = 0;
+
+            for (i = 0; i < t->c_loops && r == 0; i++)
+            {
+                c_len = bl + get_max_compression_expansion(c->id, bl);
+                if (opt_dict && c->compress_dict)
+                    r = c->compress_dict(t->in + off, bl, p, &c_len, t->wrkmem.ptr, dict.ptr, dict.len);
+                else
+                    r = c->compress(t->in + off, bl, p, &c_len, t->wrkmem.ptr);
+            }
+            t->c_lens[b] = c_len;
+            t->c_len += (unsigned long) c_len;
+            p += bl + get_max_compression_expansion(c->id, bl);
+            off += bl;
+        }
+        lzo_pclock_read(&t->h, &x_stop);
+        t->c_secs = lzo_pclock_get_elapsed(&t->h, &x_start, &x_stop);
+        if (r != 0)
+        {
+            printf("  compression failed in block %lu (%d)\n", b, r);
+            t->r = EXIT_LZO_ERROR;
+        }
+        break;
+
+    case 2:
+        lzo_pclock_read(&t->h, &x_start);
+        for (b = 0, off = 0, p = t->out_c.ptr; b < t->blocks && r == 0; b++)
+        {
+            lzo_uint bl = len - off > opt_block_size ? opt_block_size : len - off;
+            lzo_uint d_len = 0;
+
+            for (i = 0; i < t->d_loops && r == 0; i++)
+            {
+                d_len = bl;
+                if (opt_dict && c->decompress_dict_safe)
+                    r = c->decompress_dict_safe(p, t->c_lens[b], t->out_d.ptr + off, &d_len, t->wrkmem.ptr, dict.ptr, dict.len);
+                else
+                    r = t->decompress(p, t->c_lens[b], t->out_d.ptr + off, &d_len, t->wrkmem.ptr);
+                if (r == 0 && d_len != bl)
+                    r = -100;
+            }
+            p += bl + get_max_compression_expansion(c->id, bl);
+            off += bl;
+        }
+        lzo_pclock_read(&t->h, &x_stop);
+        t->d_secs = lzo_pclock_get_elapsed(&t->h, &x_start, &x_stop);
+        if (r != 0)
+        {
+            printf("  decompression failed in block %lu (%d)\n", b, r);
+            t->r = EXIT_LZO_ERROR;
+        }
+        break;
+    }
+
+    return NULL;
+}
+
+
+/* run one phase on all threads, return the wall clock time */
+static int mt_bench_phase(mt_bench_t *t, int n, int phase,
+                          lzo_pclock_handle_t *h, double *secs)
+{
+    pthread_t *tid;
+    lzo_pclock_t x_start, x_stop;
+    int i, started = 0, r = EXIT_OK;
+
+    tid = (pthread_t *) lzo_malloc(n * sizeof(pthread_t));
+    if (tid == NULL)
+        return EXIT_MEM;
+    for (i = 0; i < n; i++)
+        t[i].phase = phase;
+
+    lzo_pclock_read(h, &x_start);
+    for (i = 0; i < n; i++, started++)
+        if (pthread_create(&tid[i], NULL, mt_bench_thread, &t[i]) != 0)
+            break;
+    for (i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+    lzo_pclock_read(h, &x_stop);
+    *secs = lzo_pclock_get_elapsed(h, &x_start, &x_stop);
+
+    if (started != n)
+    {
+        printf("  cannot create thread %d\n", started);
+        r = EXIT_INTERNAL;
+    }
+    for (i = 0; i < started && r == EXIT_OK; i++)
+        r = t[i].r;
+    lzo_free(tid);
+    return r;
+}
+
+
+/* set up n threads, run the compress and decompress phases and verify */
+static int mt_bench_run(const compress_t *c, lzo_decompress_t decompress,
+                        int n, long c_loops, long d_loops,
+                        lzo_pclock_handle_t *h, mt_bench_t *t,
+                        double *c_secs, double *d_secs)
+{
+    double secs;
+    int i, r;
+
+    lzo_memset(t, 0, n * sizeof(*t));
+    for (i = 0; i < n; i++)
+    {
+        t[i].c = c;
+        t[i].decompress = decompress;
+        t[i].c_loops = c_loops;
+        t[i].d_loops = d_loops;
+        t[i].h = *h;
+    }
+
+    r = mt_bench_phase(t, n, 0, h, &secs);
+    if (r == EXIT_OK)
+        r = mt_bench_phase(t, n, 1, h, c_secs);
+    if (r == EXIT_OK)
+        r = mt_bench_phase(t, n, 2, h, d_secs);
+    for (i = 0; i < n && r == EXIT_OK; i++)
+    {
+        if (is_compressor(c) && lzo_memcmp(t[i].in, t[i].out_d.ptr, file_data.len) != 0)
+        {
+            printf("  decompression data error in thread %d\n", i);
+            r = EXIT_LZO_ERROR;
+        }
+    }
+
+    for (i = n; i-- > 0; )
+    {
+        if (t[i].c_lens)
+            lzo_free(t[i].c_lens);
+        t[i].c_lens = NULL;
+        mb_free(&t[i].wrkmem);
+        mb_free(&t[i].out_d);
+        mb_free(&t[i].out_c);
+        mb_free(&t[i].copy);
+    }
+    return r;
+}
+
+
+static double mt_mbs(double bytes, double secs)
+{
+    return (opt_pclock != 0 && secs > 0.001) ? bytes / secs / 1000000.0 : 0;
+}
+
+
+static
+int process_file_mt ( const compress_t *c, lzo_decompress_t decompress,
+                      const char *method_name,
+                      const char *file_name,
+                      long c_loops, long d_loops )
+{
+    const int n = opt_threads;
+    mt_bench_t *t;
+    lzo_pclock_handle_t h;
+    double c_secs1 = 0, d_secs1 = 0, c_secs = 0, d_secs = 0;
+    double c_bytes = (double) file_data.len * c_loops;
+    double d_bytes = (double) file_data.len * d_loops;
+    double c_mbs1, d_mbs1, c_mbs, d_mbs;
+    char perc_str[4+1];
+    const char *nn, *b;
+    int i, r;
+
+    /* threads overlap, so measure wall clock time instead of CPU time */
+    h = pch;
+#if defined(__LZOLIB_PCLOCK_CH_INCLUDED)
+    if (lzo_pclock_open(&h, LZO_PCLOCK_MONOTONIC) != 0)
+        h = pch;
+#endif
+
+    t = (mt_bench_t *) lzo_malloc(n * sizeof(mt_bench_t));
+    if (t == NULL)
+        return EXIT_MEM;
+
+    /* the single-threaded baseline for the scaling efficiency */
+    r = mt_bench_run(c, decompress, 1, c_loops, d_loops, &h, t, &c_secs1, &d_secs1);
+    c_mbs1 = mt_mbs(c_bytes, c_secs1);
+    d_mbs1 = mt_mbs(d_bytes, d_secs1);
+    if (r == EXIT_OK)
+        r = mt_bench_run(c, decompress, n, c_loops, d_loops, &h, t, &c_secs, &d_secs);
+    if (r != EXIT_OK)
+    {
+        lzo_free(t);
+        return r;
+    }
+    c_mbs = mt_mbs(c_bytes * n, c_secs);
+    d_mbs = mt_mbs(d_bytes * n, d_secs);
+    print_result(method_name, file_name, n, (unsigned long) file_data.len,
+                 t[0].blocks, t[0].c_len, c_mbs, d_mbs, 0, 0);
+
+    if (opt_verbose >= 2)
+    {
+        for (i = 0; i < n; i++)
+            printf("  thread %3d: %10lu bytes, compress %8.3f MB/sec, decompress %8.3f MB/sec\n",
+                   i, t[i].c_len, mt_mbs(c_bytes, t[i].c_secs), mt_mbs(d_bytes, t[i].d_secs));
+        printf("  1 thread:   compress %8.3f MB/sec, decompress %8.3f MB/sec\n",
+               c_mbs1, d_mbs1);
+        printf("  %d threads:  compress %8.3f MB/sec, decompress %8.3f MB/sec (%s input)\n",
+               n, c_mbs, d_mbs, opt_threads_shared ? "shared" : "disjoint");
+        printf("  efficiency:  compress %7.1f%%,      decompress %7.1f%%\n\n",
+               t_div(c_mbs * 100.0, c_mbs1 * n), t_div(d_mbs * 100.0, d_mbs1 * n));
+    }
+
+    /* the util/table.pl line with aggregate speeds, plus the efficiency */
+    if (opt_verbose >= 1)
+    {
+        for (nn = b = file_name; *nn; nn++)
+            if (*nn == '/' || *nn == '\\' || *nn == ':')
+                b = nn + 1;
+        set_perc(t[0].c_len, (unsigned long) file_data.len, perc_str);
+        printf("%-13s| %-14s %8lu %4lu %9lu %4s %s%8.3f %8.3f | x%d %5.1f%% %5.1f%%\n",
+               method_name, b, (unsigned long) file_data.len, t[0].blocks,
+               t[0].c_len, perc_str, "", c_mbs, d_mbs,
+               n, t_div(c_mbs * 100.0, c_mbs1 * n), t_div(d_mbs * 100.0, d_mbs1 * n));
+    }
+
+    lzo_free(t);
+    return EXIT_OK;
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+
 static
 int do_file ( int method, const char *file_name,
               long c_loops, long d_loops,
@@ -1251,8 +2111,10 @@ int do_file ( int method, const char *file_name,
 
     fflush(stdout); fflush(stderr);
 
+    perf_reset(0);
+
     /* read the whole file */
-    r = load_file(file_name, opt_max_data_len);
+    r = load_data(file_name, opt_max_data_len);
     if (r != 0)
         return r;
 
@@ -1265,6 +2127,8 @@ int do_file ( int method, const char *file_name,
     crc = lzo_crc32(crc, file_data.ptr, file_data.len);
     if (p_crc)
         *p_crc = crc;
+    file_data.adler = adler;
+    file_data.crc = crc;
 
     if (opt_verbose >= 2)
     {
@@ -1275,6 +2139,11 @@ int do_file ( int method, const char *file_name,
         printf("  %s\n", method_name);
     }
 
+#if defined(HAVE_PTHREAD_H)
+    if (opt_threads > 0)
+        return process_file_mt(c, decompress, method_name, file_name,
+                               c_loops, d_loops);
+#endif
     r = process_file(c, decompress, method_name, file_name,
                      t_loops, c_loops, d_loops);
 
@@ -1378,10 +2247,41 @@ int do_corpus ( const struct corpus_entry_t *corpus, int method, const char *pat
 }
 
 
+static
+int do_synthetic_corpus ( int method, long c_loops, long d_loops )
+{
+    char name[64];
+    int k, r;
+
+    for (k = 0; k < CORPUS_KINDS; k++)
+    {
+        sprintf(name, "%s%s", SYNTHETIC_PREFIX, corpus_kinds[k]);
+        r = do_file(method, name, c_loops, d_loops, NULL, NULL);
+        if (r != 0)
+            return r;
+    }
+    return EXIT_OK;
+}
+
+
 /*************************************************************************
 // usage
 **************************************************************************/
 
+static
+void banner ( void )
+{
+    static lzo_bool done = 0;
+
+    if (done)
+        return;
+    done = 1;
+    printf("\nLZO real-time data compression library (v%s, %s).\n",
+           lzo_version_string(), lzo_version_date());
+    printf("Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer\nAll Rights Reserved.\n\n");
+}
+
+
 static
 void usage ( const char *name, int exit_code, lzo_bool show_methods )
 {
@@ -1390,6 +2290,7 @@ void usage ( const char *name, int exit_code, lzo_bool show_methods )
 
     fp = stdout;
 
+    banner();
     fflush(stdout); fflush(stderr);
 
     fprintf(fp,"Usage: %s [option..] file...\n", name);
@@ -1406,7 +2307,16 @@ void usage ( const char *name, int exit_code, lzo_bool show_methods )
     fprintf(fp,"  -F      use fast assembler decompressor (if available)\n");
     fprintf(fp,"  -O      optimize compressed data (if available)\n");
     fprintf(fp,"  -s DIR  process Calgary Corpus test suite in directory `DIR'\n");
+    fprintf(fp,"  --synthetic-corpus=SIZE  generate SIZE bytes of text, json, numeric,\n");
+    fprintf(fp,"          random, zeros and mixed data (--seed=N), or name one of them\n");
+    fprintf(fp,"          as a file `synthetic:KIND'\n");
     fprintf(fp,"  -@      read list of files to compress from stdin\n");
+    fprintf(fp,"  --threads=N  run on N threads, report scaling (each has its own wrkmem)\n");
+    fprintf(fp,"  --threads-input=shared|disjoint  one input buffer or a copy per thread\n");
+    fprintf(fp,"  --format=text|json|csv  output format of the results\n");
+    fprintf(fp,"  --compare=FILE  flag speeds below a --format=json baseline\n");
+    fprintf(fp,"  --compare-threshold=PCT  allowed slowdown (default %.0f%%)\n", opt_compare_threshold);
+    fprintf(fp,"  --perf  count cycles, instructions and cache misses per phase (Linux)\n");
     fprintf(fp,"  -q      be quiet\n");
     fprintf(fp,"  -Q      be very quiet\n");
     fprintf(fp,"  -v      be verbose\n");
@@ -1480,6 +2390,7 @@ void license(void)
     FILE *fp;
 
     fp = stdout;
+    banner();
     fflush(stdout); fflush(stderr);
 
 fprintf(fp,
@@ -1605,7 +2516,9 @@ static void parse_methods(const char *p)
         {
             add_all_methods(1,M_LAST_COMPRESSOR);
             add_all_methods(9721,9729);
+            add_method(97210);
             add_all_methods(9781,9789);
+            add_method(98210);
         }
         else if (m_strcmp(p,"lzo") == 0)
             add_all_methods(1,M_MEMCPY);
@@ -1618,9 +2531,15 @@ static void parse_methods(const char *p)
         else if (m_strcmp(p,"m999") == 0)
             add_methods(x999_methods);
         else if (m_strcmp(p,"1x999") == 0)
+        {
             add_all_methods(9721,9729);
+            add_method(97210);
+        }
         else if (m_strcmp(p,"1y999") == 0)
+        {
             add_all_methods(9821,9829);
+            add_method(98210);
+        }
 #if defined(ALG_ZLIB)
         else if (m_strcmp(p,"zlib") == 0)
             add_all_methods(M_ZLIB_8_1,M_ZLIB_8_9);
@@ -1664,6 +2583,14 @@ enum {
     OPT_MAX_DICT_LEN,
     OPT_SILESIA_CORPUS,
     OPT_PCLOCK,
+    OPT_THREADS,
+    OPT_THREADS_INPUT,
+    OPT_FORMAT,
+    OPT_COMPARE,
+    OPT_COMPARE_THRESHOLD,
+    OPT_PERF,
+    OPT_SEED,
+    OPT_SYNTHETIC_CORPUS,
     OPT_UNUSED
 };
 
@@ -1680,16 +2607,24 @@ static const struct lzo_getopt_longopt_t longopts[] =
     {"calgary-corpus",   1, 0, OPT_CALGARY_CORPUS},
     {"clear-wrkmem",     0, 0, OPT_CLEAR_WRKMEM},
     {"clock",            1, 0, OPT_PCLOCK},
+    {"compare",          1, 0, OPT_COMPARE},
+    {"compare-threshold",1, 0, OPT_COMPARE_THRESHOLD},
     {"corpus",           1, 0, OPT_CALGARY_CORPUS},
     {"crc32",            0, 0, OPT_CRC32},
     {"dict",             1, 0, OPT_DICT},
     {"dump-compressed",  1, 0, OPT_DUMP},
     {"execution-time",   0, 0, OPT_EXECUTION_TIME},
+    {"format",           1, 0, OPT_FORMAT},
     {"max-data-length",  1, 0, OPT_MAX_DATA_LEN},
     {"max-dict-length",  1, 0, OPT_MAX_DICT_LEN},
+    {"seed",             1, 0, OPT_SEED},
     {"silesia-corpus",   1, 0, OPT_SILESIA_CORPUS},
+    {"synthetic-corpus", 1, 0, OPT_SYNTHETIC_CORPUS},
+    {"threads",          1, 0, OPT_THREADS},
+    {"threads-input",    1, 0, OPT_THREADS_INPUT},
     {"uclock",           1, 0, OPT_PCLOCK},
     {"methods",          1, 0, 'm'},
+    {"perf",             0, 0, OPT_PERF},
     {"totals",           0, 0, 'T'},
 
     { 0, 0, 0, 0 }
@@ -1778,6 +2713,7 @@ static int do_option(lzo_getopt_p g, int optc)
         break;
     case 'V':
     case 'V'+256:
+        banner();
         exit(EXIT_OK);
         break;
     case '@':
@@ -1835,6 +2771,58 @@ static int do_option(lzo_getopt_p g, int optc)
             pch.mode = opt_pclock;
 #endif
         break;
+    case OPT_THREADS:
+        if (!mfx_optarg || !is_digit(mfx_optarg[0]))
+            return optc;
+        opt_threads = atoi(mfx_optarg);
+#if !defined(HAVE_PTHREAD_H)
+        if (opt_threads > 0) {
+            fprintf(stderr,"%s: this build does not support --threads\n",progname);
+            return -1;
+        }
+#endif
+        break;
+    case OPT_FORMAT:
+        if (mfx_optarg && strcmp(mfx_optarg, "text") == 0)
+            opt_format = FORMAT_TEXT;
+        else if (mfx_optarg && strcmp(mfx_optarg, "json") == 0)
+            opt_format = FORMAT_JSON;
+        else if (mfx_optarg && strcmp(mfx_optarg, "csv") == 0)
+            opt_format = FORMAT_CSV;
+        else
+            return optc;
+        break;
+    case OPT_COMPARE:
+        if (!mfx_optarg || !mfx_optarg[0])
+            return optc;
+        opt_compare_file = mfx_optarg;
+        break;
+    case OPT_COMPARE_THRESHOLD:
+        if (!mfx_optarg || !is_digit(mfx_optarg[0]))
+            return optc;
+        opt_compare_threshold = atof(mfx_optarg);
+        break;
+    case OPT_PERF:
+        opt_perf = 1;
+        break;
+    case OPT_SEED:
+        if (!mfx_optarg || !is_digit(mfx_optarg[0]))
+            return optc;
+        opt_seed = (lzo_uint64_t) strtoul(mfx_optarg, NULL, 0);
+        break;
+    case OPT_SYNTHETIC_CORPUS:
+        if (!mfx_optarg || !is_digit(mfx_optarg[0]) || atol(mfx_optarg) <= 0)
+            return optc;
+        opt_synthetic_size = atol(mfx_optarg);
+        break;
+    case OPT_THREADS_INPUT:
+        if (mfx_optarg && strcmp(mfx_optarg, "shared") == 0)
+            opt_threads_shared = 1;
+        else if (mfx_optarg && strcmp(mfx_optarg, "disjoint") == 0)
+            opt_threads_shared = 0;
+        else
+            return optc;
+        break;
 
     case '\0':
         return -1;
@@ -1902,9 +2890,6 @@ int __lzo_cdecl_main main(int argc, char *argv[])
         if ((*s == '/' || *s == '\\') && s[1])
             progname = s + 1;
 
-    printf("\nLZO real-time data compression library (v%s, %s).\n",
-           lzo_version_string(), lzo_version_date());
-    printf("Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer\nAll Rights Reserved.\n\n");
 
 
 /*
@@ -1959,6 +2944,20 @@ int __lzo_cdecl_main main(int argc, char *argv[])
     if (opt_d_loops < 1)
         opt_d_loops = 1;
 
+    /* keep stdout machine-readable */
+    if (opt_format == FORMAT_TEXT)
+        banner();
+    else
+        opt_verbose = 0;
+    if (opt_perf && !perf_open())
+        opt_perf = 0;
+    if (opt_compare_file)
+    {
+        r = baseline_load(opt_compare_file);
+        if (r != EXIT_OK)
+            exit(r);
+    }
+
 
 /*
  * Step 4: start work
@@ -1974,7 +2973,9 @@ int __lzo_cdecl_main main(int argc, char *argv[])
             block_w.len = c->mem_decompress;
     }
 
-    mb_alloc(&block_w, block_w.len);
+    /* start wrkmem at a cache line, like a careful application would */
+    mb_alloc_extra(&block_w, block_w.len, 0, 64);
+    block_w.ptr = LZO_PTR_ALIGN_UP(block_w.alloc_ptr, 64);
     lzo_memset(block_w.ptr, 0, block_w.len);
 
 #if !defined(__LZO_CHECKER)
@@ -1989,7 +2990,7 @@ int __lzo_cdecl_main main(int argc, char *argv[])
         if (opt_dictionary_file)
         {
             dict_load(opt_dictionary_file);
-            if (dict.len > 0)
+            if (dict.len > 0 && opt_format == FORMAT_TEXT)
                 printf("Using dictionary '%s', %lu bytes, ID 0x%08lx.\n",
                        opt_dictionary_file,
                        (unsigned long) dict.len, (unsigned long) dict.adler);
@@ -1997,8 +2998,9 @@ int __lzo_cdecl_main main(int argc, char *argv[])
         if (dict.len == 0)
         {
             dict_set_default();
-            printf("Using default dictionary, %lu bytes, ID 0x%08lx.\n",
-                   (unsigned long) dict.len, (unsigned long) dict.adler);
+            if (opt_format == FORMAT_TEXT)
+                printf("Using default dictionary, %lu bytes, ID 0x%08lx.\n",
+                       (unsigned long) dict.len, (unsigned long) dict.adler);
         }
     }
 
@@ -2009,7 +3011,7 @@ int __lzo_cdecl_main main(int argc, char *argv[])
         int method = methods[m];
 
         i = ii;
-        if (i >= argc && opt_corpus_path == NULL && !opt_read_from_stdin)
+        if (i >= argc && opt_corpus_path == NULL && opt_synthetic_size == 0 && !opt_read_from_stdin)
             usage(progname,-1,0);
         if (m == 0 && opt_verbose >= 1)
             printf("%lu block-size\n\n", (unsigned long) opt_block_size);
@@ -2019,6 +3021,8 @@ int __lzo_cdecl_main main(int argc, char *argv[])
         if (opt_corpus_path != NULL)
             r = do_corpus(opt_corpus, method, opt_corpus_path,
                           opt_c_loops, opt_d_loops);
+        else if (opt_synthetic_size > 0 && i >= argc)
+            r = do_synthetic_corpus(method, opt_c_loops, opt_d_loops);
         else
         {
             for ( ; i < argc && r == EXIT_OK; i++)
@@ -2051,12 +3055,15 @@ int __lzo_cdecl_main main(int argc, char *argv[])
     }
     t_total = time(NULL) - t_total;
 
-    if (opt_totals)
+    print_results_end();
+    if (regressions_n > 0 && r == EXIT_OK)
+        r = EXIT_REGRESSION;
+    if (opt_totals && opt_format == FORMAT_TEXT)
         print_totals();
-    if (opt_execution_time || (methods_n > 1 && opt_verbose >= 1))
+    if ((opt_execution_time && opt_format == FORMAT_TEXT) || (methods_n > 1 && opt_verbose >= 1))
         printf("\n%s: execution time: %lu seconds\n", progname, (unsigned long) t_total);
     if (r != EXIT_OK)
-        printf("\n%s: exit code: %d\n", progname, r);
+        fprintf(opt_format == FORMAT_TEXT ? stdout : stderr, "\n%s: exit code: %d\n", progname, r);
 
     lzo_pclock_close(&pch);
     return r;
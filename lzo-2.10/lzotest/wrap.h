@@ -113,6 +113,15 @@ lzo1x_999_9_compress    ( const lzo_bytep src, lzo_uint  src_len,
                                     dict.ptr, dict.len, 0, 9);
 }
 
+LZO_PRIVATE(int)
+lzo1x_999_10_compress   ( const lzo_bytep src, lzo_uint  src_len,
+                                lzo_bytep dst, lzo_uintp dst_len,
+                                lzo_voidp wrkmem )
+{
+    return lzo1x_999_compress_level(src, src_len, dst, dst_len, wrkmem,
+                                    dict.ptr, dict.len, 0, 10);
+}
+
 #endif
 
 
@@ -199,6 +208,15 @@ lzo1y_999_9_compress    ( const lzo_bytep src, lzo_uint  src_len,
                                     dict.ptr, dict.len, 0, 9);
 }
 
+LZO_PRIVATE(int)
+lzo1y_999_10_compress   ( const lzo_bytep src, lzo_uint  src_len,
+                                lzo_bytep dst, lzo_uintp dst_len,
+                                lzo_voidp wrkmem )
+{
+    return lzo1y_999_compress_level(src, src_len, dst, dst_len, wrkmem,
+                                    dict.ptr, dict.len, 0, 10);
+}
+
 #endif
 
 
@@ -143,7 +143,7 @@ lzo1f_999_compress_callback ( const lzo_bytep in , lzo_uint  in_len,
     lzo_uint m_len, m_off;
     LZO_COMPRESS_T cc;
     LZO_COMPRESS_T * const c = &cc;
-    lzo_swd_p const swd = (lzo_swd_p) wrkmem;
+    lzo_swd_p const swd = swd_from_wrkmem(wrkmem);
     int r;
 
     /* sanity check */
@@ -209,7 +209,8 @@ lzo1f_999_compress_callback ( const lzo_bytep in , lzo_uint  in_len,
         if (m_len > 0 && lazy_match_min_gain >= 0 && c->look > m_len)
         {
             r = find_match(c,swd,1,0);
-            assert(r == 0); LZO_UNUSED(r);
+            if (r != 0)
+                return r;
             assert(c->look > 0);
 
             if (m_len <= M2_MAX_LEN && m_off <= M2_MAX_OFFSET &&
@@ -260,7 +261,8 @@ lzo1f_999_compress_callback ( const lzo_bytep in , lzo_uint  in_len,
             /* a literal */
             lit++;
             r = find_match(c,swd,1,0);
-            assert(r == 0); LZO_UNUSED(r);
+            if (r != 0)
+                return r;
         }
         else
         {
@@ -278,7 +280,8 @@ lzo1f_999_compress_callback ( const lzo_bytep in , lzo_uint  in_len,
             /* 2 - code match */
             op = code_match(c,op,m_len,m_off);
             r = find_match(c,swd,m_len,1+ahead);
-            assert(r == 0); LZO_UNUSED(r);
+            if (r != 0)
+                return r;
         }
 
         c->codesize = pd(op, out);
@@ -536,7 +536,7 @@ lzo1x_999_compress_internal ( const lzo_bytep in , lzo_uint  in_len,
     lzo_uint m_len, m_off;
     LZO_COMPRESS_T cc;
     LZO_COMPRESS_T * const c = &cc;
-    lzo_swd_p const swd = (lzo_swd_p) wrkmem;
+    lzo_swd_p const swd = swd_from_wrkmem(wrkmem);
     lzo_uint try_lazy;
     int r;
 
@@ -638,7 +638,8 @@ lzo1x_999_compress_internal ( const lzo_bytep in , lzo_uint  in_len,
             lit++;
             swd->max_chain = max_chain;
             r = find_match(c,swd,1,0);
-            assert(r == 0); LZO_UNUSED(r);
+            if (r != 0)
+                return r;
             continue;
         }
 
@@ -682,7 +683,8 @@ lzo1x_999_compress_internal ( const lzo_bytep in , lzo_uint  in_len,
             r = find_match(c,swd,1,0);
             ahead++;
 
-            assert(r == 0); LZO_UNUSED(r);
+            if (r != 0)
+                return r;
             assert(c->look > 0);
             assert(ii + lit + ahead == c->bp);
 
@@ -751,7 +753,8 @@ lzo1x_999_compress_internal ( const lzo_bytep in , lzo_uint  in_len,
         op = code_match(c,op,m_len,m_off);
         swd->max_chain = max_chain;
         r = find_match(c,swd,m_len,1+ahead);
-        assert(r == 0); LZO_UNUSED(r);
+        if (r != 0)
+            return r;
 
 lazy_match_done: ;
     }
@@ -787,6 +790,424 @@ lazy_match_done: ;
 }
 
 
+/***********************************************************************
+// optimal parsing (compression level 10)
+//
+// The match finder is run at every position of a window of OPT_N
+// positions. For each offset class (M1, M2, M1b, M3, M4) the longest
+// match with an offset in that class is kept. Then the cheapest way to
+// code the window is computed over the byte costs of the LZO codes, and
+// the chosen literal runs and matches are emitted with the usual
+// code_run() / code_match(). Very long matches end a window early and
+// are taken as they are. A search at every position is what the binary
+// tree match finder is good at, so it is always used here.
+//
+// What a code costs depends on the literals in front of it: a 2 byte
+// match needs 1 to 3 of them, an M1b match 4 or more, and the run
+// header grows at 4, 19, 274, ... literals. So every position keeps
+// the cheapest path for each of the states 0, 1, 2, 3 and 4+ literals
+// since the last match, plus the single path of literals from the
+// start of the output, whose run header is coded differently. Within
+// the 4+ state the cheaper path never ends up worse than the other
+// one, and of two equal ones the path whose header grows later wins,
+// so for LZO1X and LZO1Y the parse is optimal over the candidate
+// matches of a window. LZO1Z codes a repeated offset in one byte less,
+// which the prices do not know about.
+************************************************************************/
+
+#define OPT_N           4096        /* positions per window */
+#define OPT_NICE        128         /* take matches this long at once */
+#define OPT_CLASSES     5
+#define OPT_STATES      5           /* 0, 1, 2, 3 and 4+ literals */
+#define OPT_FIRST       OPT_STATES  /* the literals at the start of the output */
+#define OPT_INFINITY    LZO_UINT32_C(0xffffffff)
+
+typedef struct
+{
+    lzo_uint32_t price;     /* bytes needed to code the window up to here */
+    lzo_uint32_t lit;       /* number of literals since the last match */
+    lzo_uint16_t len;       /* length of the code ending here, 1 == literal */
+    lzo_uint16_t off;       /* offset of that match */
+    lzo_uint16_t next;      /* next position on the cheapest path */
+    unsigned char from;     /* state before that code */
+}
+lzo_opt_node_t;
+
+typedef struct
+{
+    lzo_uint16_t len;       /* 0 terminates the list */
+    lzo_uint16_t off;
+}
+lzo_opt_cand_t;
+
+#define OPT_NODE(i,s)   (&node[(i) * OPT_STATES + (s)])
+#define OPT_STATE(lit)  ((lit) < OPT_STATES - 1 ? (unsigned) (lit) : OPT_STATES - 1)
+
+#define SIZEOF_LZO_OPT_T \
+    ((OPT_N + 1) * OPT_STATES * sizeof(lzo_opt_node_t) + OPT_N * OPT_CLASSES * sizeof(lzo_opt_cand_t))
+
+
+/* number of bytes used by the header of a literal run of length t */
+static lzo_uint
+len_of_coded_run ( lzo_uint t, lzo_bool first )
+{
+    if (t == 0)
+        return 0;
+    if (first && t <= 238)
+        return 1;
+    if (t <= 3)
+        return 0;
+    if (t <= 18)
+        return 1;
+    return 2 + (t - 19) / 255;
+}
+
+
+/* literals that can still be added to a run of t before its header
+ * grows; of two runs with the same price the one with more is better */
+static lzo_uint
+run_slack ( lzo_uint t )
+{
+    if (t < 19)
+        return 19 - t;
+    return 255 - (t - 19) % 255;
+}
+
+
+/* keep the longest match of each offset class at the current position */
+static void
+opt_candidates ( const LZO_COMPRESS_T *c, const lzo_swd_p swd,
+                 lzo_opt_cand_t *cand )
+{
+    static const lzo_uint class_max_off[OPT_CLASSES] = {
+        M1_MAX_OFFSET, M2_MAX_OFFSET, MX_MAX_OFFSET, M3_MAX_OFFSET, M4_MAX_OFFSET
+    };
+    lzo_uint min_off[SWD_BEST_OFF];
+    lzo_uint m_len = c->m_len;
+    lzo_uint top, l, k, n = 0, last_len = 1;
+
+    if (m_len >= 2)
+    {
+        /* smallest offset that gives a match of at least length l */
+        top = LZO_MIN(m_len, (lzo_uint) SWD_BEST_OFF - 1);
+        min_off[top] = c->m_off;
+        if (swd->best_off[top] && swd->best_off[top] < min_off[top])
+            min_off[top] = swd->best_off[top];
+        for (l = top; l-- > 2; )
+        {
+            min_off[l] = min_off[l + 1];
+            if (swd->best_off[l] && swd->best_off[l] < min_off[l])
+                min_off[l] = swd->best_off[l];
+        }
+
+        for (k = 0; k < OPT_CLASSES; k++)
+        {
+            lzo_uint len, off;
+
+            if (c->m_off <= class_max_off[k])
+                len = m_len, off = c->m_off;
+            else
+            {
+                for (len = top; len >= 2 && min_off[len] > class_max_off[k]; len--)
+                    ;
+                off = (len >= 2) ? min_off[len] : 0;
+            }
+            if (len > last_len && len >= 2)
+            {
+                cand[n].len = (lzo_uint16_t) len;
+                cand[n].off = (lzo_uint16_t) off;
+                n++;
+                last_len = len;
+            }
+            if (last_len == m_len)
+                break;
+        }
+    }
+    if (n < OPT_CLASSES)
+        cand[n].len = 0;
+}
+
+
+/* keep the cheaper of the current path to y and a new one */
+static void
+opt_relax ( lzo_opt_node_t *y, lzo_uint32_t price, lzo_uint32_t lit,
+            lzo_uint len, lzo_uint off, unsigned from )
+{
+    if (price < y->price ||
+        (price == y->price && lit >= 4 && run_slack(lit) > run_slack(y->lit)))
+    {
+        y->price = price;
+        y->lit = lit;
+        y->len = (lzo_uint16_t) len;
+        y->off = (lzo_uint16_t) off;
+        y->from = (unsigned char) from;
+    }
+}
+
+
+static lzo_bytep
+opt_code_window ( LZO_COMPRESS_T *c, lzo_bytep op, lzo_opt_node_t *node,
+                  const lzo_opt_cand_t *cand, lzo_uint n,
+                  const lzo_bytep wp, const lzo_bytep *ii, lzo_uint *lit )
+{
+    const lzo_bool first = (op == c->out);
+    const lzo_uint32_t lit0 = (lzo_uint32_t) LZO_MIN(*lit, (lzo_uint) 0x7fffffffL);
+    lzo_uint i, j;
+    unsigned s, end;
+
+    for (i = 0; i <= n; i++)
+        for (s = 0; s < OPT_STATES; s++)
+            OPT_NODE(i,s)->price = OPT_INFINITY;
+    /* at the start of the output the literals are the OPT_FIRST path,
+     * whose price is computed on the fly */
+    if (!first)
+    {
+        lzo_opt_node_t * const x = OPT_NODE(0,OPT_STATE(lit0));
+        x->price = 0;
+        x->lit = lit0;
+    }
+
+/* forward pass: cheapest price of every position and state */
+    for (i = 0; i < n; i++)
+    {
+        const lzo_opt_cand_t *m = &cand[i * OPT_CLASSES];
+        lzo_uint32_t src_price[OPT_STATES + 1];
+        lzo_uint32_t src_lit[OPT_STATES + 1];
+        lzo_uint32_t price;
+        unsigned nsrc = 0, best = 0;
+        lzo_uint l, k;
+
+        for (s = 0; s < OPT_STATES; s++)
+        {
+            const lzo_opt_node_t * const x = OPT_NODE(i,s);
+            lzo_uint32_t t;
+
+            src_price[s] = x->price;
+            src_lit[s] = x->lit;
+            if (x->price == OPT_INFINITY)
+                continue;
+            /* a literal */
+            t = x->lit + 1;
+            price = x->price + 1 + (lzo_uint32_t) (len_of_coded_run(t, 0) -
+                                                   len_of_coded_run(x->lit, 0));
+            opt_relax(OPT_NODE(i + 1,OPT_STATE(t)), price, t, 1, 0, s);
+            if (x->price < src_price[best] || src_price[best] == OPT_INFINITY)
+                best = s;
+        }
+        nsrc = OPT_STATES;
+        if (first)
+        {
+            /* the first code must be a literal */
+            src_lit[OPT_FIRST] = lit0 + (lzo_uint32_t) i;
+            if (src_lit[OPT_FIRST] > 0)
+            {
+                src_price[OPT_FIRST] = (lzo_uint32_t) (i + len_of_coded_run(src_lit[OPT_FIRST], 1) -
+                                                       len_of_coded_run(lit0, 1));
+                nsrc = OPT_FIRST + 1;
+                if (src_price[OPT_FIRST] < src_price[best] || src_price[best] == OPT_INFINITY)
+                    best = OPT_FIRST;
+            }
+        }
+        if (src_price[best] == OPT_INFINITY)
+            continue;
+
+        /* matches; only those of length 2 and 3 depend on the literals
+         * in front, longer ones start from the cheapest state */
+        for (l = 2, k = 0; k < OPT_CLASSES && m[k].len != 0; k++)
+        {
+            lzo_uint max_len = LZO_MIN((lzo_uint) m[k].len, n - i);
+
+            for ( ; l <= max_len; l++)
+            {
+                lzo_uint len;
+
+                if (l > 3)
+                {
+                    len = len_of_coded_match(l, m[k].off, src_lit[best]);
+                    if (len != 0)
+                        opt_relax(OPT_NODE(i + l,0), src_price[best] + (lzo_uint32_t) len,
+                                  0, l, m[k].off, best);
+                    continue;
+                }
+                for (s = 0; s < nsrc; s++)
+                {
+                    if (src_price[s] == OPT_INFINITY)
+                        continue;
+                    /* compressed-data compatibility [see above] */
+                    if (l == 2 && s == OPT_FIRST)
+                        continue;
+                    len = len_of_coded_match(l, m[k].off, src_lit[s]);
+                    if (len != 0)
+                        opt_relax(OPT_NODE(i + l,0), src_price[s] + (lzo_uint32_t) len,
+                                  0, l, m[k].off, s);
+                }
+            }
+        }
+    }
+
+/* backward pass: link the cheapest path */
+    end = OPT_FIRST;
+    for (s = 0; s < OPT_STATES; s++)
+        if (OPT_NODE(n,s)->price != OPT_INFINITY &&
+            (end == OPT_FIRST || OPT_NODE(n,s)->price < OPT_NODE(n,end)->price))
+            end = s;
+    if (first && end != OPT_FIRST &&
+        n + len_of_coded_run(lit0 + n, 1) - len_of_coded_run(lit0, 1) <= OPT_NODE(n,end)->price)
+        end = OPT_FIRST;
+    assert(first || end != OPT_FIRST);
+    for (j = n, s = end; j > 0; j = i)
+    {
+        if (s == OPT_FIRST)
+        {
+            for (i = 0; i < j; i++)
+                OPT_NODE(i,0)->next = (lzo_uint16_t) (i + 1);
+            break;
+        }
+        i = j - OPT_NODE(j,s)->len;
+        OPT_NODE(i,0)->next = (lzo_uint16_t) j;
+        s = OPT_NODE(j,s)->from;
+    }
+
+/* code the path; every match ends in state 0 */
+    for (i = 0; i < n; i = j)
+    {
+        j = OPT_NODE(i,0)->next;
+        if (j - i == 1)
+        {
+            if (*lit == 0)
+                *ii = wp + i;
+            *lit += 1;
+        }
+        else
+        {
+            assert(*lit == 0 || *ii + *lit == wp + i);
+            op = code_run(c,op,*ii,*lit,j - i);
+            *lit = 0;
+            op = code_match(c,op,j - i,OPT_NODE(j,0)->off);
+        }
+    }
+
+    return op;
+}
+
+
+static int
+lzo1x_999_compress_optimal ( const lzo_bytep in , lzo_uint  in_len,
+                                   lzo_bytep out, lzo_uintp out_len,
+                                   lzo_voidp wrkmem,
+                             const lzo_bytep dict, lzo_uint dict_len,
+                                   lzo_callback_p cb )
+{
+    lzo_bytep op;
+    const lzo_bytep ii;
+    lzo_uint lit;
+    LZO_COMPRESS_T cc;
+    LZO_COMPRESS_T * const c = &cc;
+    lzo_swd_p const swd = swd_from_wrkmem(wrkmem);
+    lzo_opt_node_t * const node =
+        (lzo_opt_node_t *) ((lzo_bytep) wrkmem + LZO1X_999_MEM_COMPRESS);
+    lzo_opt_cand_t * const cand = (lzo_opt_cand_t *) (node + (OPT_N + 1) * OPT_STATES);
+    int r;
+
+    /* sanity check */
+#if defined(LZO1X)
+    LZO_COMPILE_TIME_ASSERT(LZO1X_999_10_MEM_COMPRESS >= LZO1X_999_MEM_COMPRESS + SIZEOF_LZO_OPT_T)
+#elif defined(LZO1Y)
+    LZO_COMPILE_TIME_ASSERT(LZO1Y_999_10_MEM_COMPRESS >= LZO1Y_999_MEM_COMPRESS + SIZEOF_LZO_OPT_T)
+#elif defined(LZO1Z)
+    LZO_COMPILE_TIME_ASSERT(LZO1Z_999_10_MEM_COMPRESS >= LZO1Z_999_MEM_COMPRESS + SIZEOF_LZO_OPT_T)
+#endif
+    LZO_COMPILE_TIME_ASSERT(OPT_N <= 0xffff)
+    LZO_COMPILE_TIME_ASSERT(SWD_F <= 0xffff)
+    LZO_COMPILE_TIME_ASSERT(OPT_NICE < SWD_F)
+
+    c->init = 0;
+    c->ip = c->in = in;
+    c->in_end = in + in_len;
+    c->out = out;
+    c->cb = cb;
+    c->m1a_m = c->m1b_m = c->m2_m = c->m3_m = c->m4_m = 0;
+    c->lit1_r = c->lit2_r = c->lit3_r = 0;
+
+    op = out;
+    ii = c->ip;
+    lit = 0;
+    c->r1_lit = c->r1_m_len = 0;
+
+    r = init_match(c,swd,dict,dict_len,3);
+    if (r != 0)
+        return r;
+    swd->max_chain = 4096;
+
+    r = find_match(c,swd,0,0);
+    if (r != 0)
+        return r;
+    while (c->look > 0)
+    {
+        const lzo_bytep wp = c->bp;
+        lzo_uint n = 0;
+        lzo_uint m_len = 0, m_off = 0;
+
+        c->codesize = pd(op, out);
+
+        /* collect the matches of a window */
+        for (;;)
+        {
+            assert(c->bp == wp + n);
+            if (c->m_len >= OPT_NICE && !(op == out && lit == 0 && n == 0))
+            {
+                m_len = c->m_len;
+                m_off = c->m_off;
+                break;
+            }
+            opt_candidates(c,swd,&cand[n * OPT_CLASSES]);
+            n++;
+            r = find_match(c,swd,1,0);
+            if (r != 0)
+                return r;
+            if (c->look == 0 || n == OPT_N)
+                break;
+        }
+
+        op = opt_code_window(c,op,node,cand,n,wp,&ii,&lit);
+
+        /* a long match ended the window */
+        if (m_len > 0)
+        {
+            assert_match(swd,m_len,m_off);
+            op = code_run(c,op,ii,lit,m_len);
+            lit = 0;
+            op = code_match(c,op,m_len,m_off);
+            r = find_match(c,swd,m_len,1);
+            if (r != 0)
+                return r;
+        }
+    }
+
+    /* store final run */
+    if (lit > 0)
+        op = STORE_RUN(c,op,ii,lit);
+
+#if defined(LZO_EOF_CODE)
+    *op++ = M4_MARKER | 1;
+    *op++ = 0;
+    *op++ = 0;
+#endif
+
+    c->codesize = pd(op, out);
+    assert(c->textsize == in_len);
+
+    *out_len = pd(op, out);
+
+    if (c->cb && c->cb->nprogress)
+        (*c->cb->nprogress)(c->cb, c->textsize, c->codesize, 0);
+
+    assert(c->lit_bytes + c->match_bytes == in_len);
+
+    return LZO_E_OK;
+}
+
+
 /***********************************************************************
 //
 ************************************************************************/
@@ -806,7 +1227,7 @@ lzo1x_999_compress_level    ( const lzo_bytep in , lzo_uint  in_len,
         lzo_uint max_lazy;
         lzo_uint nice_length;
         lzo_uint max_chain;
-        lzo_uint32_t flags;
+        lzo_uint32_t flags;     /* 1: use best_off[]; the binary tree (2) is for level 10 */
     } c[9] = {
         /* faster compression */
         {   0,     0,     0,     8,    4,   0 },
@@ -820,23 +1241,47 @@ lzo1x_999_compress_level    ( const lzo_bytep in , lzo_uint  in_len,
         {   2, SWD_F, SWD_F, SWD_F, 4096,   1 }
         /* max. compression */
     };
+    lzo_voidp mem = NULL;
+    int r;
 
-    if (compression_level < 1 || compression_level > 9)
+    if (compression_level < 1 || compression_level > 10)
         return LZO_E_ERROR;
 
-    compression_level -= 1;
-    return lzo1x_999_compress_internal(in, in_len, out, out_len, wrkmem,
-                                       dict, dict_len, cb,
-                                       c[compression_level].try_lazy_parm,
-                                       c[compression_level].good_length,
-                                       c[compression_level].max_lazy,
+    /* without wrkmem the work memory comes from the allocator of cb */
+    if (wrkmem == NULL)
+    {
+        if (cb == NULL || cb->nalloc == 0 || cb->nfree == 0)
+            return LZO_E_INVALID_ARGUMENT;
+        mem = (*cb->nalloc)(cb, 1, compression_level == 10 ?
+                            LZO1X_999_10_MEM_COMPRESS : LZO1X_999_MEM_COMPRESS);
+        if (mem == NULL)
+            return LZO_E_OUT_OF_MEMORY;
+        wrkmem = mem;
+    }
+
+    if (compression_level == 10)
+        r = lzo1x_999_compress_optimal(in, in_len, out, out_len, wrkmem,
+                                       dict, dict_len, cb);
+    else
+    {
+        compression_level -= 1;
+        r = lzo1x_999_compress_internal(in, in_len, out, out_len, wrkmem,
+                                        dict, dict_len, cb,
+                                        c[compression_level].try_lazy_parm,
+                                        c[compression_level].good_length,
+                                        c[compression_level].max_lazy,
 #if 0
-                                       c[compression_level].nice_length,
+                                        c[compression_level].nice_length,
 #else
-                                       0,
+                                        0,
 #endif
-                                       c[compression_level].max_chain,
-                                       c[compression_level].flags);
+                                        c[compression_level].max_chain,
+                                        c[compression_level].flags);
+    }
+
+    if (mem != NULL)
+        (*cb->nfree)(cb, mem);
+    return r;
 }
 
 
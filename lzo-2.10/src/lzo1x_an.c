@@ -0,0 +1,227 @@
+/* lzo1x_an.c -- match and literal statistics of LZO1X compressed data
+
+   This file is part of the LZO real-time data compression library.
+
+   Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   The LZO library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   The LZO library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the LZO library; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+   http://www.oberhumer.com/opensource/lzo/
+ */
+
+
+#include "config1x.h"
+
+
+/***********************************************************************
+// The analyzer parses a compressed stream exactly like
+// lzo1x_decompress_safe() in lzo1x_d.ch, but writes no output: it only
+// keeps the uncompressed position to check the match offsets. Any valid
+// LZO1X stream can be analyzed, no matter which compressor produced it.
+************************************************************************/
+
+#define NEED_IP(x) \
+    if ((lzo_uint)(ip_end - ip) < (lzo_uint)(x))  goto input_overrun
+
+
+static void
+an_literals(lzo1x_stats_t *s, lzo_uint len, lzo_uint code_bytes)
+{
+    s->count[LZO1X_STATS_LITERAL] += 1;
+    s->bytes[LZO1X_STATS_LITERAL] += len;
+    s->code_bytes[LZO1X_STATS_LITERAL] += code_bytes;
+    s->literal_run[LZO_MIN(len, (lzo_uint) LZO1X_STATS_MAX_LEN)] += 1;
+}
+
+
+static void
+an_match(lzo1x_stats_t *s, int cls, lzo_uint len, lzo_uint off,
+         lzo_uint code_bytes)
+{
+    unsigned bits = 0;
+
+    while (off >> bits)
+        bits++;
+    s->count[cls] += 1;
+    s->bytes[cls] += len;
+    s->code_bytes[cls] += code_bytes;
+    s->match_len[LZO_MIN(len, (lzo_uint) LZO1X_STATS_MAX_LEN)] += 1;
+    s->offset_bits[bits] += 1;
+}
+
+
+/***********************************************************************
+//
+************************************************************************/
+
+LZO_PUBLIC(int)
+lzo1x_analyze ( const lzo_bytep in, lzo_uint in_len, lzo1x_stats_t *stats )
+{
+    const lzo_bytep ip = in;
+    const lzo_bytep const ip_end = in + in_len;
+    const lzo_bytep p = in;         /* start of the current code */
+    lzo_uint op = 0;                /* uncompressed position */
+    lzo_uint t, off, code = 0;
+    int cls;
+
+    if (stats == NULL || (in == NULL && in_len > 0))
+        return LZO_E_INVALID_ARGUMENT;
+    lzo_memset(stats, 0, sizeof(*stats));
+
+    NEED_IP(1);
+    if (*ip > 17)
+    {
+        t = *ip++ - 17;
+        if (t < 4)
+        {
+            code = 1;
+            goto match_next;
+        }
+        NEED_IP(t + 3);
+        an_literals(stats, t, 1 + t);
+        ip += t; op += t;
+        goto first_literal_run;
+    }
+
+    for (;;)
+    {
+        NEED_IP(3);
+        p = ip;
+        t = *ip++;
+        if (t >= 16)
+            goto match;
+        /* a literal run */
+        if (t == 0)
+        {
+            while (*ip == 0)
+            {
+                t += 255;
+                ip++;
+                NEED_IP(1);
+            }
+            t += 15 + *ip++;
+        }
+        t += 3;
+        NEED_IP(t + 3);
+        ip += t; op += t;
+        an_literals(stats, t, pd(ip, p));
+
+first_literal_run:
+        p = ip;
+        t = *ip++;
+        if (t >= 16)
+            goto match;
+        /* a M1 match right after a literal run */
+        off = 1 + M2_MAX_OFFSET + (t >> 2) + ((lzo_uint) *ip++ << 2);
+        t = 3;
+        cls = LZO1X_STATS_M1;
+        goto match_found;
+
+        for (;;)
+        {
+match:
+            if (t >= 64)                /* a M2 match */
+            {
+                off = 1 + ((t >> 2) & 7) + ((lzo_uint) *ip++ << 3);
+                t = (t >> 5) - 1 + 2;
+                cls = LZO1X_STATS_M2;
+            }
+            else if (t >= 32)           /* a M3 match */
+            {
+                t &= 31;
+                if (t == 0)
+                {
+                    NEED_IP(1);
+                    while (*ip == 0)
+                    {
+                        t += 255;
+                        ip++;
+                        NEED_IP(1);
+                    }
+                    t += 31 + *ip++;
+                }
+                NEED_IP(2);
+                off = 1 + (ip[0] >> 2) + ((lzo_uint) ip[1] << 6);
+                ip += 2;
+                t += 2;
+                cls = LZO1X_STATS_M3;
+            }
+            else if (t >= 16)           /* a M4 match */
+            {
+                off = (t & 8) << 11;
+                t &= 7;
+                if (t == 0)
+                {
+                    NEED_IP(1);
+                    while (*ip == 0)
+                    {
+                        t += 255;
+                        ip++;
+                        NEED_IP(1);
+                    }
+                    t += 7 + *ip++;
+                }
+                NEED_IP(2);
+                off += (ip[0] >> 2) + ((lzo_uint) ip[1] << 6);
+                ip += 2;
+                if (off == 0)
+                    goto eof_found;
+                off += M3_MAX_OFFSET;
+                t += 2;
+                cls = LZO1X_STATS_M4;
+            }
+            else                        /* a M1 match */
+            {
+                NEED_IP(1);
+                off = 1 + (t >> 2) + ((lzo_uint) *ip++ << 2);
+                t = 2;
+                cls = LZO1X_STATS_M1;
+            }
+
+match_found:
+            if (off > op)
+                return LZO_E_LOOKBEHIND_OVERRUN;
+            an_match(stats, cls, t, off, pd(ip, p));
+            op += t;
+
+            /* up to 3 literals are coded in the low bits of the match */
+            t = ip[-2] & 3;
+            if (t == 0)
+                break;
+            code = 0;
+
+match_next:
+            NEED_IP(t + 3);
+            an_literals(stats, t, code + t);
+            ip += t; op += t;
+            p = ip;
+            t = *ip++;
+        }
+    }
+
+eof_found:
+    return (ip == ip_end ? LZO_E_OK :
+           (ip < ip_end  ? LZO_E_INPUT_NOT_CONSUMED : LZO_E_INPUT_OVERRUN));
+
+input_overrun:
+    return LZO_E_INPUT_OVERRUN;
+}
+
+
+/* vim:set ts=4 sw=4 et: */
@@ -0,0 +1,62 @@
+/* lzo1x_di.c -- LZO1X in-place decompression
+
+   This file is part of the LZO real-time data compression library.
+
+   Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   The LZO library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   The LZO library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the LZO library; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+   http://www.oberhumer.com/opensource/lzo/
+ */
+
+
+
+#include "config1x.h"
+
+
+/***********************************************************************
+// The compressed data is stored at the end of buf[] and decompressed
+// to its start, as shown in examples/overlap.c. The output never
+// overtakes the input that is still to be read, as long as buf[] has
+// room for the uncompressed data plus LZO1X_DECOMPRESS_INPLACE_MARGIN.
+// On entry *dst_len is the length of the uncompressed data (or an upper
+// bound), on return the number of bytes written.
+************************************************************************/
+
+LZO_PUBLIC(int)
+lzo1x_decompress_inplace ( lzo_bytep buf, lzo_uint buf_len,
+                           lzo_uint src_len, lzo_uintp dst_len,
+                           lzo_voidp wrkmem )
+{
+    lzo_uint need = *dst_len + LZO1X_DECOMPRESS_INPLACE_MARGIN(*dst_len);
+
+    LZO_UNUSED(wrkmem);
+
+    if (src_len > buf_len)
+        return LZO_E_INPUT_OVERRUN;
+    if (need < *dst_len || need > buf_len)
+    {
+        *dst_len = 0;
+        return LZO_E_OUTPUT_OVERRUN;
+    }
+    return lzo1x_decompress_safe(buf + buf_len - src_len, src_len, buf, dst_len, NULL);
+}
+
+
+/* vim:set ts=4 sw=4 et: */
@@ -0,0 +1,219 @@
+/* lzo1x_tr.c -- train a preset dictionary for LZO1X-999
+
+   This file is part of the LZO real-time data compression library.
+
+   Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   The LZO library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   The LZO library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the LZO library; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+   http://www.oberhumer.com/opensource/lzo/
+ */
+
+
+#include "config1x.h"
+
+
+/***********************************************************************
+// The trainer cuts the sample data into epochs and picks the segment of
+// each epoch whose short substrings (d-mers) occur in the most chunks of
+// the sample set. A d-mer that only repeats inside one chunk is found by
+// the compressor anyway, so it is counted once per chunk. The counts of
+// a chosen segment are cleared so that later epochs prefer new content.
+// Finally the segments are stored with the best ones at the end of the
+// dictionary, where they can be reached with the cheapest offsets.
+************************************************************************/
+
+#define DT_D            6           /* length of a scored substring */
+#define DT_K            64          /* length of a dictionary segment */
+#define DT_CHUNK        16384       /* d-mers are counted once per chunk */
+#define DT_HBITS        16
+#define DT_HSIZE        (1ul << DT_HBITS)
+#define DT_MAX_SEGS     (M4_MAX_OFFSET / DT_K)
+
+typedef struct
+{
+    lzo_uint pos;
+    lzo_uint32_t score;
+} lzo1x_dt_seg_t;
+
+
+static __lzo_inline lzo_uint
+dt_hash(const lzo_bytep p)
+{
+    lzo_uint32_t v;
+
+    v  = (lzo_uint32_t) p[0] | ((lzo_uint32_t) p[1] << 8);
+    v |= ((lzo_uint32_t) p[2] << 16) | ((lzo_uint32_t) p[3] << 24);
+    v  = (v * LZO_UINT32_C(0x9e3779b1)) & LZO_0xffffffffL;
+    v ^= ((lzo_uint32_t) p[4] | ((lzo_uint32_t) p[5] << 8)) * LZO_UINT32_C(0x85eb);
+    v  = (v * LZO_UINT32_C(0x9e3779b1)) & LZO_0xffffffffL;
+    return (lzo_uint) (v >> (32 - DT_HBITS));
+}
+
+
+/* find the best segment whose start lies in [e0, e1) */
+static lzo_uint32_t
+dt_best_segment(const lzo_bytep samples, const lzo_uint *sample_lens,
+                lzo_uint nsamples, lzo_uint e0, lzo_uint e1,
+                const lzo_uint32_t *counts, lzo_uint *best_pos)
+{
+    lzo_uint32_t best = 0;
+    lzo_uint s, start = 0;
+
+    for (s = 0; s < nsamples && start < e1; start += sample_lens[s++])
+    {
+        lzo_uint lo, hi, p;
+        lzo_uint32_t score = 0;
+        const lzo_uint end = start + sample_lens[s];
+
+        if (end < start + DT_K || end <= e0)
+            continue;
+        lo = LZO_MAX(e0, start);
+        hi = LZO_MIN(e1, end - DT_K + 1);
+        if (lo >= hi)
+            continue;
+
+        /* score of the segment at lo, then slide it up to hi */
+        for (p = lo; p <= lo + DT_K - DT_D; p++)
+            score += counts[dt_hash(samples + p)];
+        for (p = lo; ; )
+        {
+            if (score > best)
+            {
+                best = score;
+                *best_pos = p;
+            }
+            if (++p >= hi)
+                break;
+            score -= counts[dt_hash(samples + p - 1)];
+            score += counts[dt_hash(samples + p + DT_K - DT_D)];
+        }
+    }
+    return best;
+}
+
+
+/***********************************************************************
+//
+************************************************************************/
+
+LZO_PUBLIC(int)
+lzo1x_train_dict ( const lzo_bytep samples, const lzo_uint *sample_lens,
+                         lzo_uint nsamples,
+                         lzo_bytep dict, lzo_uintp dict_len,
+                         lzo_voidp wrkmem )
+{
+    lzo_uint32_t * const counts = (lzo_uint32_t *) wrkmem;
+    lzo_uint32_t * const last = counts + DT_HSIZE;
+    lzo1x_dt_seg_t * const seg = (lzo1x_dt_seg_t *) last;
+    lzo_uint total, cap, nseg, epoch_len, e0, n, i, s, op;
+    lzo_uint32_t chunk_id;
+
+    LZO_COMPILE_TIME_ASSERT(DT_MAX_SEGS * sizeof(lzo1x_dt_seg_t) <= DT_HSIZE * sizeof(lzo_uint32_t))
+    LZO_COMPILE_TIME_ASSERT(LZO1X_TRAIN_DICT_MEM >= 2 * DT_HSIZE * sizeof(lzo_uint32_t))
+
+    if (dict == NULL || dict_len == NULL || wrkmem == NULL)
+        return LZO_E_INVALID_ARGUMENT;
+    if (nsamples > 0 && (samples == NULL || sample_lens == NULL))
+        return LZO_E_INVALID_ARGUMENT;
+
+    cap = LZO_MIN(*dict_len, (lzo_uint) M4_MAX_OFFSET);
+    for (total = 0, s = 0; s < nsamples; s++)
+        total += sample_lens[s];
+
+    /* small sample sets fit into the dictionary as they are */
+    if (total <= cap)
+    {
+        if (total > 0)
+            lzo_memcpy(dict, samples, total);
+        *dict_len = total;
+        return LZO_E_OK;
+    }
+
+/* pass 1: count the number of chunks each d-mer occurs in */
+    lzo_memset(counts, 0, 2 * DT_HSIZE * sizeof(lzo_uint32_t));
+    chunk_id = 0;
+    for (op = 0, s = 0; s < nsamples; op += sample_lens[s++])
+    {
+        lzo_uint p;
+
+        for (p = 0; p + DT_D <= sample_lens[s]; p++)
+        {
+            lzo_uint h;
+
+            if (p % DT_CHUNK == 0)
+                chunk_id++;
+            h = dt_hash(samples + op + p);
+            if (last[h] != chunk_id)
+            {
+                last[h] = chunk_id;
+                counts[h]++;
+            }
+        }
+    }
+
+/* pass 2: pick the best segment of each epoch */
+    nseg = cap / DT_K;
+    if (nseg == 0)
+    {
+        *dict_len = 0;
+        return LZO_E_OK;
+    }
+    epoch_len = LZO_MAX(total / nseg, (lzo_uint) DT_K);
+
+    n = 0;
+    for (e0 = 0; e0 < total && n < nseg; e0 += epoch_len)
+    {
+        lzo_uint pos = 0, p;
+        lzo_uint32_t score;
+
+        score = dt_best_segment(samples, sample_lens, nsamples,
+                                e0, e0 + epoch_len, counts, &pos);
+        if (score == 0)
+            continue;
+        for (p = pos; p <= pos + DT_K - DT_D; p++)
+            counts[dt_hash(samples + p)] = 0;
+        seg[n].pos = pos;
+        seg[n].score = score;
+        n++;
+    }
+
+/* sort by ascending score, so that the best segments come last */
+    for (i = 1; i < n; i++)
+    {
+        lzo1x_dt_seg_t t = seg[i];
+        lzo_uint j = i;
+
+        while (j > 0 && seg[j - 1].score > t.score)
+        {
+            seg[j] = seg[j - 1];
+            j--;
+        }
+        seg[j] = t;
+    }
+
+    for (op = 0, i = 0; i < n; i++, op += DT_K)
+        lzo_memcpy(dict + op, samples + seg[i].pos, DT_K);
+    *dict_len = op;
+
+    return LZO_E_OK;
+}
+
+
+/* vim:set ts=4 sw=4 et: */
@@ -90,7 +90,7 @@ lzo2a_999_compress_callback ( const lzo_bytep in , lzo_uint  in_len,
     lzo_uint m_len, m_off;
     LZO_COMPRESS_T cc;
     LZO_COMPRESS_T * const c = &cc;
-    lzo_swd_p const swd = (lzo_swd_p) wrkmem;
+    lzo_swd_p const swd = swd_from_wrkmem(wrkmem);
     int r;
 
     lzo_uint32_t b = 0;     /* bit buffer */
@@ -165,7 +165,8 @@ lzo2a_999_compress_callback ( const lzo_bytep in , lzo_uint  in_len,
             unsigned char lit = LZO_BYTE(swd->b_char);
 
             r = find_match(c,swd,1,0);
-            assert(r == 0); LZO_UNUSED(r);
+            if (r != 0)
+                return r;
             assert(c->look > 0);
 
 #if (SWD_N >= 8192)
@@ -217,7 +218,8 @@ lzo2a_999_compress_callback ( const lzo_bytep in , lzo_uint  in_len,
             putbyte(swd->b_char);
             c->lit_bytes++;
             r = find_match(c,swd,1,0);
-            assert(r == 0); LZO_UNUSED(r);
+            if (r != 0)
+                return r;
         }
         else
         {
@@ -285,7 +287,8 @@ lzo2a_999_compress_callback ( const lzo_bytep in , lzo_uint  in_len,
                 }
             }
             r = find_match(c,swd,m_len,1+ahead);
-            assert(r == 0); LZO_UNUSED(r);
+            if (r != 0)
+                return r;
         }
 
         c->codesize = pd(op, out);
@@ -0,0 +1,148 @@
+/* lzo_bound.c -- buffer and work memory sizes for each algorithm
+
+   This file is part of the LZO real-time data compression library.
+
+   Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   The LZO library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   The LZO library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the LZO library; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+   http://www.oberhumer.com/opensource/lzo/
+ */
+
+
+
+#include "lzo_conf.h"
+#include <lzo/lzo1.h>
+#include <lzo/lzo1a.h>
+#include <lzo/lzo1b.h>
+#include <lzo/lzo1c.h>
+#include <lzo/lzo1f.h>
+#include <lzo/lzo1x.h>
+#include <lzo/lzo1y.h>
+#include <lzo/lzo1z.h>
+#include <lzo/lzo2a.h>
+
+
+/***********************************************************************
+// worst case size of the compressed data, see doc/LZO.FAQ
+************************************************************************/
+
+LZO_PUBLIC(lzo_uint)
+lzo_compress_bound(int method, lzo_uint src_len)
+{
+    lzo_uint extra;
+
+    switch (method)
+    {
+    case LZO_METHOD_LZO1:  case LZO_METHOD_LZO1A:
+    case LZO_METHOD_LZO1B: case LZO_METHOD_LZO1C:
+    case LZO_METHOD_LZO1F: case LZO_METHOD_LZO1X:
+    case LZO_METHOD_LZO1Y: case LZO_METHOD_LZO1Z:
+        extra = src_len / 16 + 64 + 3;
+        break;
+    case LZO_METHOD_LZO2A:
+        /* every literal costs an extra flag bit */
+        extra = src_len / 8 + 128 + 3;
+        break;
+    default:
+        return 0;
+    }
+    if (src_len > LZO_UINT_MAX - extra)
+        return 0;
+    return src_len + extra;
+}
+
+
+/***********************************************************************
+// work memory of the compressor of a given level; the levels are the
+// numbers in the names of the compressors, e.g. 999 for lzo1x_999_compress
+************************************************************************/
+
+LZO_PUBLIC(lzo_uint)
+lzo_wrkmem_size(int method, int level)
+{
+    switch (method)
+    {
+    case LZO_METHOD_LZO1:
+        if (level == 1)   return LZO1_MEM_COMPRESS;
+        if (level == 99)  return LZO1_99_MEM_COMPRESS;
+        break;
+    case LZO_METHOD_LZO1A:
+        if (level == 1)   return LZO1A_MEM_COMPRESS;
+        if (level == 99)  return LZO1A_99_MEM_COMPRESS;
+        break;
+    case LZO_METHOD_LZO1B:
+        if (level >= 1 && level <= 9) return LZO1B_MEM_COMPRESS;
+        if (level == 99)  return LZO1B_99_MEM_COMPRESS;
+        if (level == 999) return LZO1B_999_MEM_COMPRESS;
+        break;
+    case LZO_METHOD_LZO1C:
+        if (level >= 1 && level <= 9) return LZO1C_MEM_COMPRESS;
+        if (level == 99)  return LZO1C_99_MEM_COMPRESS;
+        if (level == 999) return LZO1C_999_MEM_COMPRESS;
+        break;
+    case LZO_METHOD_LZO1F:
+        if (level == 1)   return LZO1F_MEM_COMPRESS;
+        if (level == 999) return LZO1F_999_MEM_COMPRESS;
+        break;
+    /* levels 2 to 9 are those of lzo1x_999_compress_level() */
+    case LZO_METHOD_LZO1X:
+        if (level == 1)   return LZO1X_1_MEM_COMPRESS;
+        if ((level >= 2 && level <= 9) || level == 999) return LZO1X_999_MEM_COMPRESS;
+        if (level == 10)  return LZO1X_999_10_MEM_COMPRESS;
+        break;
+    case LZO_METHOD_LZO1Y:
+        if (level == 1)   return LZO1Y_MEM_COMPRESS;
+        if ((level >= 2 && level <= 9) || level == 999) return LZO1Y_999_MEM_COMPRESS;
+        if (level == 10)  return LZO1Y_999_10_MEM_COMPRESS;
+        break;
+    case LZO_METHOD_LZO1Z:
+        if ((level >= 2 && level <= 9) || level == 999) return LZO1Z_999_MEM_COMPRESS;
+        if (level == 10)  return LZO1Z_999_10_MEM_COMPRESS;
+        break;
+    case LZO_METHOD_LZO2A:
+        if (level == 999) return LZO2A_999_MEM_COMPRESS;
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+
+/***********************************************************************
+// bytes past the end of the decompressed data that the decompressor
+// may write to; the dst buffer must be this much larger
+************************************************************************/
+
+LZO_PUBLIC(lzo_uint)
+lzo_decompress_overrun(int method)
+{
+    switch (method & ~LZO_METHOD_ASM_FAST)
+    {
+    case LZO_METHOD_LZO1F: case LZO_METHOD_LZO1X: case LZO_METHOD_LZO1Y:
+        /* see lzo_asm.h */
+        return (method & LZO_METHOD_ASM_FAST) ? 3 : 0;
+    default:
+        return 0;
+    }
+}
+
+
+/* vim:set ts=4 sw=4 et: */
@@ -0,0 +1,391 @@
+/* lzo_pool.c -- a process-wide pool of compressor work memory
+
+   This file is part of the LZO real-time data compression library.
+
+   Copyright (C) 1996-2017 Markus Franz Xaver Johannes Oberhumer
+   All Rights Reserved.
+
+   The LZO library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License, or (at your option) any later version.
+
+   The LZO library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the LZO library; see the file COPYING.
+   If not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   Markus F.X.J. Oberhumer
+   <markus@oberhumer.com>
+   http://www.oberhumer.com/opensource/lzo/
+ */
+
+
+#include "lzo_conf.h"
+
+#if !defined(LZO_CFG_NO_MMAP) && (LZO_OS_POSIX || LZO_OS_CYGWIN)
+#  define POOL_MMAP 1
+#  include <sys/types.h>
+#  include <sys/mman.h>
+#  if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#    define MAP_ANONYMOUS MAP_ANON
+#  endif
+#elif (LZO_OS_WIN32 || LZO_OS_WIN64)
+#  define POOL_VIRTUALALLOC 1
+#  include <windows.h>
+#else
+#  include <stdlib.h>
+#endif
+
+
+/***********************************************************************
+// The work memory of a compressor is only a few hundred KiB, too small
+// for a huge page of its own, and glibc serves it with a fresh mmap()
+// for every call, so each compression first takes a page fault on
+// every page of its dictionary. The pool maps arenas of POOL_HUGE
+// bytes, aligned so that the kernel can back them with a transparent
+// huge page, touches them once and cuts them into regions of one size.
+// A region goes back to its arena on release and is handed out again
+// already faulted in, but not cleared: the output of a compressor that
+// does not initialize its dictionary, such as LZO1C-1 and LZO1F-1, then
+// depends on earlier calls, though it is always valid.
+//
+// The first page of an arena holds its header. All arenas are on one
+// list, guarded by a spin lock that is never held across a system call.
+// Without a spin lock for the compiler, or above the size limit, the
+// regions are mapped and unmapped directly.
+************************************************************************/
+
+#define POOL_PAGE       4096ul
+#define POOL_HUGE       (2ul * 1024ul * 1024ul)
+#define POOL_DEFAULT_MAX_BYTES  (16ul * 1024ul * 1024ul)
+
+#if (LZO_CC_CLANG || LZO_CC_GNUC || LZO_CC_INTELC_GNUC) && !(LZO_CC_CLANG_C2)
+static volatile int pool_lock_word;
+#  define POOL_LOCK() \
+    while (__sync_lock_test_and_set(&pool_lock_word, 1)) while (pool_lock_word) { }
+#  define POOL_UNLOCK()     __sync_lock_release(&pool_lock_word)
+#elif (POOL_VIRTUALALLOC)
+static volatile LONG pool_lock_word;
+#  define POOL_LOCK() \
+    while (InterlockedExchange(&pool_lock_word, 1)) while (pool_lock_word) { }
+#  define POOL_UNLOCK()     InterlockedExchange(&pool_lock_word, 0)
+#else
+#  define POOL_NO_LOCK 1
+#  define POOL_LOCK()       ((void) 0)
+#  define POOL_UNLOCK()     ((void) 0)
+#endif
+
+typedef struct pool_arena_t {
+    struct pool_arena_t *next;
+    lzo_bytep base;             /* of the mapping */
+    lzo_uint size;              /* of the mapping */
+    lzo_uint region;            /* size of each region */
+    lzo_uint regions;
+    lzo_uint nfree;
+    lzo_voidp free;             /* linked through their first word */
+} pool_arena_t;
+
+static pool_arena_t *pool_arenas = NULL;
+static unsigned pool_flags = LZO_WRKMEM_HUGEPAGE | LZO_WRKMEM_PREFAULT;
+static lzo_uint pool_max_bytes = POOL_DEFAULT_MAX_BYTES;
+static lzo_uint pool_bytes = 0;             /* mapped or being mapped */
+static lzo_wrkmem_stats_t pool_stats;
+
+
+/***********************************************************************
+// system memory
+************************************************************************/
+
+static lzo_bytep
+pool_map(lzo_uint size)
+{
+#if (POOL_MMAP)
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : (lzo_bytep) p;
+#elif (POOL_VIRTUALALLOC)
+    return (lzo_bytep) VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    return (lzo_bytep) malloc(size);
+#endif
+}
+
+static void
+pool_unmap(lzo_bytep p, lzo_uint size)
+{
+#if (POOL_MMAP)
+    munmap((void *) p, size);
+#elif (POOL_VIRTUALALLOC)
+    LZO_UNUSED(size);
+    VirtualFree((LPVOID) p, 0, MEM_RELEASE);
+#else
+    LZO_UNUSED(size);
+    free(p);
+#endif
+}
+
+/* a mapping of size bytes aligned to POOL_HUGE where that is possible */
+static lzo_bytep
+pool_map_huge(lzo_uint size, unsigned flags)
+{
+#if (POOL_MMAP)
+    lzo_bytep p;
+    lzo_bytep q;
+    lzo_uint head;
+
+    if (size > LZO_UINT_MAX - POOL_HUGE)
+        return NULL;
+    p = pool_map(size + POOL_HUGE);
+    if (p == NULL)
+        return NULL;
+    q = (lzo_bytep) (((lzo_uintptr_t) p + POOL_HUGE - 1) & ~(lzo_uintptr_t) (POOL_HUGE - 1));
+    head = pd(q, p);
+    if (head > 0)
+        munmap((void *) p, head);
+    munmap((void *) (q + size), POOL_HUGE - head);
+#if defined(MADV_HUGEPAGE)
+    if (flags & LZO_WRKMEM_HUGEPAGE)
+        (void) madvise((void *) q, size, MADV_HUGEPAGE);
+#endif
+    LZO_UNUSED(flags);
+    return q;
+#else
+    LZO_UNUSED(flags);
+    return pool_map(size);
+#endif
+}
+
+
+/***********************************************************************
+// arenas
+************************************************************************/
+
+static lzo_uint
+pool_arena_size(lzo_uint region)
+{
+    if (region > POOL_HUGE - POOL_PAGE)
+        return ((region + POOL_PAGE + POOL_HUGE - 1) / POOL_HUGE) * POOL_HUGE;
+    return POOL_HUGE;
+}
+
+static pool_arena_t *
+pool_arena_new(lzo_uint region, lzo_uint size, unsigned flags)
+{
+    pool_arena_t *a;
+    lzo_bytep p;
+    lzo_uint i;
+
+    p = pool_map_huge(size, flags);
+    if (p == NULL)
+        return NULL;
+    if (flags & LZO_WRKMEM_PREFAULT)
+    {
+        for (i = 0; i < size; i += POOL_PAGE)
+            ((volatile unsigned char *) p)[i] = 0;
+    }
+
+    a = (pool_arena_t *) (lzo_voidp) p;
+    a->next = NULL;
+    a->base = p;
+    a->size = size;
+    a->region = region;
+    a->regions = (size - POOL_PAGE) / region;
+    a->nfree = a->regions;
+    a->free = NULL;
+    for (i = a->regions; i > 0; i--)
+    {
+        lzo_voidp r = (lzo_voidp) (p + POOL_PAGE + (i - 1) * region);
+        * (lzo_voidp *) r = a->free;
+        a->free = r;
+    }
+    return a;
+}
+
+/* the lock is held */
+static lzo_voidp
+pool_arena_take(pool_arena_t *a)
+{
+    lzo_voidp r = a->free;
+
+    a->free = * (lzo_voidp *) r;
+    a->nfree -= 1;
+    pool_stats.free -= 1;
+    return r;
+}
+
+/* unlinks the arenas without a region in use while the pool is larger
+ * than max_bytes; the lock is held */
+static pool_arena_t *
+pool_arena_unlink(lzo_uint max_bytes)
+{
+    pool_arena_t **pp = &pool_arenas;
+    pool_arena_t *unused = NULL;
+
+    while (*pp != NULL && pool_bytes > max_bytes)
+    {
+        pool_arena_t *a = *pp;
+        if (a->nfree == a->regions)
+        {
+            *pp = a->next;
+            a->next = unused;
+            unused = a;
+            pool_bytes -= a->size;
+            pool_stats.arenas -= 1;
+            pool_stats.bytes -= a->size;
+            pool_stats.free -= a->regions;
+        }
+        else
+            pp = &a->next;
+    }
+    return unused;
+}
+
+static lzo_uint
+pool_arena_free_list(pool_arena_t *a)
+{
+    lzo_uint n = 0;
+
+    while (a != NULL)
+    {
+        pool_arena_t *next = a->next;
+        n += a->size;
+        pool_unmap(a->base, a->size);
+        a = next;
+    }
+    return n;
+}
+
+
+/***********************************************************************
+// public interface
+************************************************************************/
+
+LZO_PUBLIC(lzo_voidp)
+lzo_wrkmem_acquire(lzo_uint size)
+{
+    pool_arena_t *a;
+    lzo_uint region, arena_size;
+    unsigned flags;
+    lzo_voidp r;
+
+    if (size == 0 || size > LZO_UINT_MAX - POOL_HUGE)
+        return NULL;
+    region = (size + POOL_PAGE - 1) & ~(POOL_PAGE - 1);
+    arena_size = pool_arena_size(region);
+
+    POOL_LOCK();
+    for (a = pool_arenas; a != NULL; a = a->next)
+    {
+        if (a->region == region && a->nfree > 0)
+        {
+            r = pool_arena_take(a);
+            pool_stats.hits += 1;
+            POOL_UNLOCK();
+            return r;
+        }
+    }
+#if (POOL_NO_LOCK)
+    if (1)
+#else
+    if (arena_size > pool_max_bytes - LZO_MIN(pool_bytes, pool_max_bytes))
+#endif
+    {
+        pool_stats.direct += 1;
+        POOL_UNLOCK();
+        return pool_map(region);
+    }
+    pool_bytes += arena_size;
+    flags = pool_flags;
+    POOL_UNLOCK();
+
+    a = pool_arena_new(region, arena_size, flags);
+
+    POOL_LOCK();
+    if (a == NULL)
+    {
+        pool_bytes -= arena_size;
+        POOL_UNLOCK();
+        return NULL;
+    }
+    a->next = pool_arenas;
+    pool_arenas = a;
+    pool_stats.misses += 1;
+    pool_stats.arenas += 1;
+    pool_stats.bytes += a->size;
+    pool_stats.free += a->regions;
+    r = pool_arena_take(a);
+    POOL_UNLOCK();
+    return r;
+}
+
+
+LZO_PUBLIC(void)
+lzo_wrkmem_release(lzo_voidp wrkmem, lzo_uint size)
+{
+    pool_arena_t *a;
+    lzo_bytep p = (lzo_bytep) wrkmem;
+
+    if (p == NULL)
+        return;
+    POOL_LOCK();
+    for (a = pool_arenas; a != NULL; a = a->next)
+    {
+        if (p >= a->base && p < a->base + a->size)
+        {
+            * (lzo_voidp *) wrkmem = a->free;
+            a->free = wrkmem;
+            a->nfree += 1;
+            pool_stats.free += 1;
+            POOL_UNLOCK();
+            return;
+        }
+    }
+    POOL_UNLOCK();
+    pool_unmap(p, (size + POOL_PAGE - 1) & ~(POOL_PAGE - 1));
+}
+
+
+LZO_PUBLIC(int)
+lzo_wrkmem_pool(unsigned flags, lzo_uint max_bytes)
+{
+    pool_arena_t *unused;
+
+    if (flags & ~(unsigned) (LZO_WRKMEM_HUGEPAGE | LZO_WRKMEM_PREFAULT))
+        return LZO_E_INVALID_ARGUMENT;
+    POOL_LOCK();
+    pool_flags = flags;
+    pool_max_bytes = max_bytes;
+    unused = pool_arena_unlink(max_bytes);
+    POOL_UNLOCK();
+    pool_arena_free_list(unused);
+    return LZO_E_OK;
+}
+
+
+LZO_PUBLIC(lzo_uint)
+lzo_wrkmem_trim(void)
+{
+    pool_arena_t *unused;
+
+    POOL_LOCK();
+    unused = pool_arena_unlink(0);
+    POOL_UNLOCK();
+    return pool_arena_free_list(unused);
+}
+
+
+LZO_PUBLIC(void)
+lzo_wrkmem_stats(lzo_wrkmem_stats_t *stats)
+{
+    POOL_LOCK();
+    *stats = pool_stats;
+    POOL_UNLOCK();
+}
+
+
+/* vim:set ts=4 sw=4 et: */
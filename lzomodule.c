@@ -36,7 +36,13 @@
 #define PY_SSIZE_T_CLEAN
 
 #include <Python.h>
+#include <math.h>
 #include <string.h>
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
 #include <lzo/lzo1.h>
 #include <lzo/lzo1a.h>
 #include <lzo/lzo1b.h>
@@ -55,399 +61,2486 @@
 #undef UNUSED
 #define UNUSED(var)     ((void)&var)
 
-static PyObject *LzoError;
+/* per module state, so the module works with subinterpreters and with
+ * the free-threaded build; there is no other mutable global state */
+#define N_ALGORITHMS    9
+
+typedef struct {
+    PyObject *error;            /* lzo.error */
+    PyObject *str_algorithm;    /* interned keyword names */
+    PyObject *str_threads;
+    PyObject *str_optimize;
+    PyObject *str_filter;
+    PyObject *str_typesize;
+    PyObject *str_progress;
+    PyObject *str_progress_bytes;
+    PyObject *str_cancel;
+    PyObject *str_timeout;
+    PyObject *str_dictionary;
+    PyObject *names[N_ALGORITHMS];  /* interned algorithm names */
+    PyObject *allocator;        /* of set_allocator(), or NULL */
+    PyThread_type_lock allocator_lock;
+} lzo_state;
+
+static lzo_state *
+get_lzo_state(PyObject *module)
+{
+    return (lzo_state *) PyModule_GetState(module);
+}
 
 // custom function type definitions to allow compatibility of various algorithms
 typedef int (*lzo_compress_fn)(const lzo_bytep, lzo_uint, lzo_bytep, lzo_uintp, lzo_voidp);
 typedef int (*lzo_decompress_fn)(const lzo_bytep, lzo_uint, lzo_bytep, lzo_uintp, lzo_voidp /* NOT USED */);
+typedef int (*lzo_compress_level_fn)(const lzo_bytep, lzo_uint, lzo_bytep, lzo_uintp, lzo_voidp,
+                                     const lzo_bytep, lzo_uint, lzo_callback_p, int);
+typedef int (*lzo_decompress_dict_fn)(const lzo_bytep, lzo_uint, lzo_bytep, lzo_uintp, lzo_voidp /* NOT USED */,
+                                      const lzo_bytep, lzo_uint);
+typedef int (*lzo_optimize_src_fn)(lzo_bytep, lzo_uint, const lzo_bytep, lzo_uintp, lzo_voidp /* NOT USED */);
+
+// compression level 10 (optimal parsing) of the LZO1X family
+static int
+lzo1x_999_10_compress(const lzo_bytep src, lzo_uint src_len, lzo_bytep dst, lzo_uintp dst_len, lzo_voidp wrkmem)
+{
+    return lzo1x_999_compress_level(src, src_len, dst, dst_len, wrkmem, NULL, 0, NULL, 10);
+}
+
+static int
+lzo1y_999_10_compress(const lzo_bytep src, lzo_uint src_len, lzo_bytep dst, lzo_uintp dst_len, lzo_voidp wrkmem)
+{
+    return lzo1y_999_compress_level(src, src_len, dst, dst_len, wrkmem, NULL, 0, NULL, 10);
+}
+
+static int
+lzo1z_999_10_compress(const lzo_bytep src, lzo_uint src_len, lzo_bytep dst, lzo_uintp dst_len, lzo_voidp wrkmem)
+{
+    return lzo1z_999_compress_level(src, src_len, dst, dst_len, wrkmem, NULL, 0, NULL, 10);
+}
+
 
 /***********************************************************************
-// compress
+// algorithms
+//
+// The index into this table is the value of the constants lzo.LZO1,
+// lzo.LZO1A, ... which can be passed instead of the name, and the same
+// as LZO_METHOD_LZO1, ... of lzo_compress_bound().
 ************************************************************************/
 
-static /* const */ char compress__doc__[] =
-"compress(string[,level[,header[,algorithm]]]) -- Compress string, returning a string "
-"containing compressed data.\n"
-"level  - Set compression level of either 1 (default) or 9.\n"
-"header - Include metadata header for decompression in the output "
-"(default: True).\n"
-"algorithm (keyword argument)  - can be either LZO1, LZO1A, LZO1B, LZO1C, LZO1F, LZO1X, LZO1Y, LZO1Z, LZO2A."
-"(default: LZO1X).\n"
-;
+typedef struct {
+    const char *name;
+    lzo_uint32_t mem_1;
+    lzo_compress_fn compress_1;
+    lzo_uint32_t mem_999;
+    lzo_compress_fn compress_999;
+    lzo_uint32_t mem_10;                    /* level 10, if any */
+    lzo_compress_fn compress_10;
+    lzo_compress_level_fn compress_level;   /* threads > 1, if supported */
+    lzo_decompress_fn decompress;
+    lzo_decompress_dict_fn decompress_dict;
+    lzo_optimize_src_fn optimize_src;       /* optimize=True, if supported */
+    const lzo_compress_fn *levels;          /* of LEVEL_INDEX(), if any */
+} lzo_algorithm_t;
+
+/* LZO1B and LZO1C have a compressor for each of the levels 1 to 9, 99
+ * and 999, see lzo_wrkmem_size() for their work memory */
+#define N_LEVELS            11
+#define LEVEL_INDEX(level) \
+    ((level) >= 1 && (level) <= 9 ? (level) - 1 : (level) == 99 ? 9 : (level) == 999 ? 10 : -1)
+
+static const lzo_compress_fn lzo1b_levels[N_LEVELS] =
+{
+    &lzo1b_1_compress, &lzo1b_2_compress, &lzo1b_3_compress, &lzo1b_4_compress,
+    &lzo1b_5_compress, &lzo1b_6_compress, &lzo1b_7_compress, &lzo1b_8_compress,
+    &lzo1b_9_compress, &lzo1b_99_compress, &lzo1b_999_compress
+};
 
-static PyObject *
-compress(PyObject *dummy, PyObject *args, PyObject *kwds)
+static const lzo_compress_fn lzo1c_levels[N_LEVELS] =
 {
-    PyObject *result_str;
-    lzo_voidp wrkmem = NULL;
+    &lzo1c_1_compress, &lzo1c_2_compress, &lzo1c_3_compress, &lzo1c_4_compress,
+    &lzo1c_5_compress, &lzo1c_6_compress, &lzo1c_7_compress, &lzo1c_8_compress,
+    &lzo1c_9_compress, &lzo1c_99_compress, &lzo1c_999_compress
+};
+
+static const lzo_algorithm_t algorithms[N_ALGORITHMS] =
+{
+    { "LZO1",  LZO1_MEM_COMPRESS,      &lzo1_compress,      LZO1_99_MEM_COMPRESS,   &lzo1_99_compress,
+      0, NULL, NULL, &lzo1_decompress, NULL, NULL, NULL },
+    { "LZO1A", LZO1A_MEM_COMPRESS,     &lzo1a_compress,     LZO1A_99_MEM_COMPRESS,  &lzo1a_99_compress,
+      0, NULL, NULL, &lzo1a_decompress, NULL, NULL, NULL },
+    { "LZO1B", LZO1B_MEM_COMPRESS,     &lzo1b_1_compress,   LZO1B_999_MEM_COMPRESS, &lzo1b_999_compress,
+      0, NULL, NULL, &lzo1b_decompress_safe, NULL, NULL, lzo1b_levels },
+    { "LZO1C", LZO1C_MEM_COMPRESS,     &lzo1c_1_compress,   LZO1C_999_MEM_COMPRESS, &lzo1c_999_compress,
+      0, NULL, NULL, &lzo1c_decompress_safe, NULL, NULL, lzo1c_levels },
+    { "LZO1F", LZO1F_MEM_COMPRESS,     &lzo1f_1_compress,   LZO1F_999_MEM_COMPRESS, &lzo1f_999_compress,
+      0, NULL, NULL, &lzo1f_decompress_safe, NULL, NULL, NULL },
+    { "LZO1X", LZO1X_1_MEM_COMPRESS,   &lzo1x_1_compress,   LZO1X_999_MEM_COMPRESS, &lzo1x_999_compress,
+      LZO1X_999_10_MEM_COMPRESS, &lzo1x_999_10_compress, &lzo1x_999_compress_level,
+      &lzo1x_decompress_safe, &lzo1x_decompress_dict_safe, &lzo1x_optimize_src, NULL },
+    { "LZO1Y", LZO1Y_MEM_COMPRESS,     &lzo1y_1_compress,   LZO1Y_999_MEM_COMPRESS, &lzo1y_999_compress,
+      LZO1Y_999_10_MEM_COMPRESS, &lzo1y_999_10_compress, &lzo1y_999_compress_level,
+      &lzo1y_decompress_safe, &lzo1y_decompress_dict_safe, &lzo1y_optimize_src, NULL },
+    { "LZO1Z", LZO1Z_999_MEM_COMPRESS, &lzo1z_999_compress, LZO1Z_999_MEM_COMPRESS, &lzo1z_999_compress,
+      LZO1Z_999_10_MEM_COMPRESS, &lzo1z_999_10_compress, &lzo1z_999_compress_level,
+      &lzo1z_decompress_safe, &lzo1z_decompress_dict_safe, NULL, NULL },
+    { "LZO2A", LZO2A_999_MEM_COMPRESS, &lzo2a_999_compress, LZO2A_999_MEM_COMPRESS, &lzo2a_999_compress,
+      0, NULL, NULL, &lzo2a_decompress_safe, NULL, NULL, NULL },
+};
+
+#define DEFAULT_ALGORITHM   (&algorithms[LZO_METHOD_LZO1X])
+#define ALG_METHOD(alg)     ((int) ((alg) - algorithms))
+
+/* Look up the algorithm argument: a name or one of the constants. The
+ * names used in Python source are interned, so they are usually found
+ * without comparing any characters. Unknown names fall back to LZO1X,
+ * as they always have, but now with a DeprecationWarning.
+ */
+static const lzo_algorithm_t *
+get_algorithm(lzo_state *st, PyObject *obj)
+{
+    Py_ssize_t i;
+
+    if (obj == NULL)
+        return DEFAULT_ALGORITHM;
+    if (PyUnicode_Check(obj))
+    {
+        for (i = 0; i < N_ALGORITHMS; i++)
+            if (obj == st->names[i])
+                return &algorithms[i];
+        for (i = 0; i < N_ALGORITHMS; i++)
+            if (PyUnicode_CompareWithASCIIString(obj, algorithms[i].name) == 0)
+                return &algorithms[i];
+        if (PyErr_WarnFormat(PyExc_DeprecationWarning, 1,
+                             "unknown algorithm %R, using LZO1X", obj) < 0)
+            return NULL;
+        return DEFAULT_ALGORITHM;
+    }
+    if (PyLong_Check(obj))
+    {
+        i = PyLong_AsSsize_t(obj);
+        if (i >= 0 && i < N_ALGORITHMS)
+            return &algorithms[i];
+        if (!PyErr_Occurred() || PyErr_ExceptionMatches(PyExc_OverflowError))
+        {
+            PyErr_Clear();
+            PyErr_Format(PyExc_ValueError, "unknown algorithm %R", obj);
+        }
+        return NULL;
+    }
+    PyErr_Format(PyExc_TypeError, "algorithm must be str or int, not %.50s", Py_TYPE(obj)->tp_name);
+    return NULL;
+}
+
+/* algorithm="auto", which compress() and compress_bound() accept */
+static int
+is_auto(PyObject *obj)
+{
+    return obj != NULL && PyUnicode_Check(obj) && PyUnicode_CompareWithASCIIString(obj, "auto") == 0;
+}
+
+
+/***********************************************************************
+// argument parsing for METH_FASTCALL | METH_KEYWORDS
+//
+// Like PyArg_ParseTupleAndKeywords() with a format of "s#|ii$..": up to
+// max_pos positional arguments, followed by keyword-only ones whose
+// (interned) names are in kwlist. Arguments not given are left NULL.
+************************************************************************/
+
+static int
+parse_args(const char *fname, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames,
+           Py_ssize_t max_pos, PyObject **pos, Py_ssize_t nkw, PyObject *const *kwlist, PyObject **kw)
+{
+    Py_ssize_t i, j, n;
+
+    if (nargs < 1 || nargs > max_pos)
+    {
+        if (nargs < 1)
+            PyErr_Format(PyExc_TypeError, "%s() missing required argument (pos 1)", fname);
+        else
+            PyErr_Format(PyExc_TypeError, "%s() takes at most %zd positional arguments (%zd given)",
+                         fname, max_pos, nargs);
+        return 0;
+    }
+    for (i = 0; i < max_pos; i++)
+        pos[i] = i < nargs ? args[i] : NULL;
+    for (j = 0; j < nkw; j++)
+        kw[j] = NULL;
+
+    n = kwnames != NULL ? PyTuple_GET_SIZE(kwnames) : 0;
+    for (i = 0; i < n; i++)
+    {
+        PyObject *key = PyTuple_GET_ITEM(kwnames, i);
+
+        for (j = 0; j < nkw; j++)
+            if (key == kwlist[j])
+                break;
+        if (j == nkw)
+            for (j = 0; j < nkw; j++)
+                if (PyUnicode_Compare(key, kwlist[j]) == 0)
+                    break;
+        if (j == nkw)
+        {
+            PyErr_Format(PyExc_TypeError, "%s() got an unexpected keyword argument %R", fname, key);
+            return 0;
+        }
+        kw[j] = args[nargs + i];
+    }
+    return 1;
+}
+
+/* "s#": bytes directly, everything else as PyArg_Parse() does it */
+static int
+get_data(PyObject *obj, const lzo_bytep *p, Py_ssize_t *len)
+{
+    if (PyBytes_CheckExact(obj))
+    {
+        *p = (const lzo_bytep) PyBytes_AS_STRING(obj);
+        *len = PyBytes_GET_SIZE(obj);
+        return 1;
+    }
+    return PyArg_Parse(obj, "s#", p, len);
+}
+
+/* "i" */
+static int
+get_int(PyObject *obj, int *v)
+{
+    if (obj == NULL)
+        return 1;
+    if (PyLong_CheckExact(obj))
+    {
+        int overflow;
+        long l = PyLong_AsLongAndOverflow(obj, &overflow);
+
+        if (overflow == 0 && l >= INT_MIN && l <= INT_MAX)
+        {
+            *v = (int) l;
+            return 1;
+        }
+    }
+    return PyArg_Parse(obj, "i", v);
+}
+
+
+/***********************************************************************
+// work memory
+//
+// The work memory of the compressors and the scratch buffers of the
+// filters come from PyMem_Malloc(), or from the allocator set with
+// set_allocator(): a callable, which is called with a size and returns
+// a writable buffer that is kept until the memory is no longer needed,
+// or a PyCapsule named "lzo.callback" holding an lzo_callback_t whose
+// nalloc and nfree are used. Memory is always allocated and freed with
+// the GIL held, and aligned to a cache line. By default the work memory
+// comes from the pre-faulted pool of lzo_wrkmem_acquire(), see
+// set_wrkmem_pool(), as a fresh malloc() of a few hundred KiB costs a
+// page fault per page on every call.
+************************************************************************/
+
+#define MEM_ALIGN           64
+#define ALLOCATOR_CAPSULE   "lzo.callback"
+
+/* what mem_alloc() allocates */
+#define MEM_SCRATCH         0
+#define MEM_WRKMEM          1
+#define MEM_WRKMEM_CLEAR    2   /* work memory cleared by default */
+
+/* The compressors of LZO1C below level 999 and of LZO1F-1 do not clear
+ * their dictionary (see config1c.h and config1f.h), they only check that
+ * the matches it points to are in the input. Their output then depends
+ * on what the work memory held before, which from the pool is the
+ * dictionary of an earlier call, so the default allocator clears it for
+ * them, and compress_blocks() before every block. LZO1X-1 and LZO1Y-1 need no clearing: lzo_conf.h always defines
+ * UA_GET_LE32, so lzo1x_1.c and lzo1y_1.c store 16-bit offsets instead
+ * of pointers, which makes them LZO_DETERMINISTIC and they clear the
+ * dictionary themselves at the start of every call. */
+#define MEM_WRKMEM_FAST(method) \
+    ((method) < 0 || (method) == LZO_METHOD_LZO1C || (method) == LZO_METHOD_LZO1F ? \
+     MEM_WRKMEM_CLEAR : MEM_WRKMEM)
+
+typedef struct {
+    lzo_voidp ptr;              /* aligned to MEM_ALIGN */
+    lzo_voidp base;             /* as allocated */
+    PyObject *obj;              /* the buffer or capsule, or NULL */
+    lzo_callback_p cb;          /* of a capsule, or NULL */
+    Py_buffer view;             /* of a buffer */
+    lzo_uint pooled;            /* size acquired from the pool, or 0 */
+} lzo_mem_t;
+
+static void
+mem_free(lzo_mem_t *m)
+{
+    if (m->cb != NULL)
+    {
+        if (m->base != NULL)
+            (*m->cb->nfree)(m->cb, m->base);
+    }
+    else if (m->obj != NULL)
+        PyBuffer_Release(&m->view);
+    else if (m->pooled != 0)
+        lzo_wrkmem_release(m->base, m->pooled);
+    else
+        PyMem_Free(m->base);
+    Py_XDECREF(m->obj);
+    m->obj = NULL;
+    m->cb = NULL;
+    m->base = m->ptr = NULL;
+    m->pooled = 0;
+}
+
+/* returns NULL with an exception set on failure; kind is one of MEM_*,
+ * the default allocator takes work memory from the pool */
+static lzo_voidp
+mem_alloc(lzo_state *st, lzo_mem_t *m, size_t size, int kind)
+{
+    PyObject *allocator;
+
+    memset(m, 0, sizeof(*m));
+    if (size > (size_t) PY_SSIZE_T_MAX - MEM_ALIGN)
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    size += MEM_ALIGN - 1;
+
+    PyThread_acquire_lock(st->allocator_lock, WAIT_LOCK);
+    allocator = st->allocator;
+    Py_XINCREF(allocator);
+    PyThread_release_lock(st->allocator_lock);
+
+    if (allocator == NULL && kind != MEM_SCRATCH)
+    {
+        m->base = lzo_wrkmem_acquire((lzo_uint) size);
+        m->pooled = (lzo_uint) size;
+        if (m->base != NULL && kind == MEM_WRKMEM_CLEAR)
+            memset(m->base, 0, size);
+    }
+    else if (allocator == NULL)
+        m->base = PyMem_Malloc(size);
+    else if (PyCapsule_CheckExact(allocator))
+    {
+        m->obj = allocator;
+        m->cb = (lzo_callback_p) PyCapsule_GetPointer(allocator, ALLOCATOR_CAPSULE);
+        m->base = (*m->cb->nalloc)(m->cb, 1, (lzo_uint) size);
+    }
+    else
+    {
+        PyObject *buf = PyObject_CallFunction(allocator, "n", (Py_ssize_t) size);
+
+        Py_DECREF(allocator);
+        if (buf == NULL)
+            return NULL;
+        if (PyObject_GetBuffer(buf, &m->view, PyBUF_WRITABLE) < 0)
+        {
+            Py_DECREF(buf);
+            return NULL;
+        }
+        m->obj = buf;
+        if (m->view.len < (Py_ssize_t) size)
+        {
+            PyErr_Format(PyExc_ValueError, "allocator returned %zd bytes, %zd were needed",
+                         m->view.len, (Py_ssize_t) size);
+            mem_free(m);
+            return NULL;
+        }
+        m->base = m->view.buf;
+    }
+    if (m->base == NULL)
+    {
+        mem_free(m);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    m->ptr = (lzo_voidp) (((size_t) m->base + MEM_ALIGN - 1) & ~(size_t) (MEM_ALIGN - 1));
+    return m->ptr;
+}
+
+
+/***********************************************************************
+// progress and cancellation
+//
+// The 999 compressors of LZO1X, LZO1Y and LZO1Z call the nprogress of
+// their lzo_callback_t about every KiB of input, without the GIL.
+// progress_cb() only adds up the bytes and looks at the clock for the
+// timeout. Every step bytes the calling thread takes the GIL back to
+// call the progress callable and cancel.is_set(); the threads of
+// compress_blocks() only count. A compressor is stopped by clearing
+// the nprogress of its callback, see lzoconf.h.
+************************************************************************/
+
+#define PROGRESS_STEP       (1024L * 1024L)
+
+#define PROGRESS_TIMEOUT    1
+#define PROGRESS_CANCEL     2
+#define PROGRESS_ERROR      3   /* the progress callable raised */
+
+typedef struct {
+    PyObject *progress;         /* progress(done, total), or NULL */
+    PyObject *cancel;           /* has is_set(), or NULL */
+    double deadline;            /* of progress_clock(), or 0 */
+    lzo_uint64_t total;
+    lzo_uint64_t step;
+    lzo_uint64_t done;          /* bytes of input compressed so far */
+    lzo_uint64_t next;          /* the calling thread reports at this done */
+    lzo_uint64_t reported;      /* done of the last report */
+    int stop;                   /* 0 or PROGRESS_* */
+    PyObject *exc_type, *exc_value, *exc_tb;    /* of PROGRESS_ERROR; 3.12+
+                                                 * only uses exc_value */
+    PyThreadState *tstate;      /* of the calling thread */
+    unsigned long owner;        /* its PyThread_get_thread_ident() */
+    PyThread_type_lock lock;    /* protects done, next and stop */
+} lzo_progress_t;
+
+/* seconds of a monotonic clock, which can be read without the GIL */
+static double
+progress_clock(void)
+{
+#if defined(_WIN32)
+    return (double) GetTickCount64() / 1000.0;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* call progress and cancel.is_set() with the GIL held */
+static int
+progress_report(lzo_progress_t *p, lzo_uint64_t done)
+{
+    PyObject *r;
+    int stop = 0;
+
+    p->reported = done;
+    if (p->cancel != NULL)
+    {
+        int set;
+
+        r = PyObject_CallMethod(p->cancel, "is_set", NULL);
+        set = r != NULL ? PyObject_IsTrue(r) : -1;
+        Py_XDECREF(r);
+        if (set != 0)
+            stop = set < 0 ? PROGRESS_ERROR : PROGRESS_CANCEL;
+    }
+    if (stop == 0 && p->progress != NULL)
+    {
+        r = PyObject_CallFunction(p->progress, "KK", (unsigned long long) done,
+                                  (unsigned long long) p->total);
+        if (r == NULL)
+            stop = PROGRESS_ERROR;
+        Py_XDECREF(r);
+    }
+    if (stop == PROGRESS_ERROR)
+#if PY_VERSION_HEX >= 0x030c0000
+        p->exc_value = PyErr_GetRaisedException();
+#else
+        PyErr_Fetch(&p->exc_type, &p->exc_value, &p->exc_tb);
+#endif
+    return stop;
+}
+
+static void __LZO_CDECL
+progress_cb(lzo_callback_p self, lzo_uint textsize, lzo_uint codesize, int state)
+{
+    lzo_progress_t *p = (lzo_progress_t *) self->user1;
+    lzo_uint64_t done = 0;
+    int report = 0, stop;
+
+    UNUSED(codesize);
+    UNUSED(state);
+    PyThread_acquire_lock(p->lock, WAIT_LOCK);
+    p->done += textsize - (lzo_uint) self->user2;
+    self->user2 = (lzo_xint) textsize;
+    if (p->stop == 0 && p->deadline > 0 && progress_clock() >= p->deadline)
+        p->stop = PROGRESS_TIMEOUT;
+    if (p->stop == 0 && p->done >= p->next && PyThread_get_thread_ident() == p->owner)
+    {
+        done = p->done;
+        p->next = done + p->step;
+        report = 1;
+    }
+    stop = p->stop;
+    PyThread_release_lock(p->lock);
+
+    if (report)
+    {
+        PyEval_RestoreThread(p->tstate);
+        stop = progress_report(p, done);
+        PyEval_SaveThread();
+        if (stop != 0)
+        {
+            PyThread_acquire_lock(p->lock, WAIT_LOCK);
+            p->stop = stop;
+            PyThread_release_lock(p->lock);
+        }
+    }
+    if (stop != 0)
+        self->nprogress = (lzo_progress_func_t) 0;
+}
+
+/* the lzo_callback_t of one compressor call */
+static lzo_callback_p
+progress_callback(lzo_progress_t *p, lzo_callback_p cb)
+{
+    if (p == NULL)
+        return NULL;
+    memset(cb, 0, sizeof(*cb));
+    cb->nprogress = progress_cb;
+    cb->user1 = (lzo_voidp) p;
+    cb->user2 = 0;
+    return cb;
+}
+
+/* Called with the GIL after compressing, with err of the compressor.
+ * Reports the end of a successful compression and returns 0, or sets
+ * the exception of a stopped one and returns -1.
+ */
+static int
+progress_finish(lzo_state *st, lzo_progress_t *p, int err)
+{
+    if (p->stop == 0 && err == LZO_E_OK && p->reported < p->total)
+        p->stop = progress_report(p, p->total);
+    switch (p->stop)
+    {
+    case PROGRESS_TIMEOUT:
+        PyErr_SetString(PyExc_TimeoutError, "Compression timed out");
+        return -1;
+    case PROGRESS_CANCEL:
+        PyErr_SetString(st->error, "Compression cancelled");
+        return -1;
+    case PROGRESS_ERROR:
+#if PY_VERSION_HEX >= 0x030c0000
+        PyErr_SetRaisedException(p->exc_value);
+#else
+        PyErr_Restore(p->exc_type, p->exc_value, p->exc_tb);
+#endif
+        p->exc_type = p->exc_value = p->exc_tb = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void
+progress_free(lzo_progress_t *p)
+{
+    Py_XDECREF(p->exc_type);
+    Py_XDECREF(p->exc_value);
+    Py_XDECREF(p->exc_tb);
+    if (p->lock != NULL)
+        PyThread_free_lock(p->lock);
+}
+
+
+/***********************************************************************
+// parallel compression
+//
+// The input is cut into blocks of MT_BLOCK_LEN bytes which are compressed
+// independently, each one with the preceding MT_DICT_LEN bytes of input
+// as preset dictionary. The output of block i is decompressed with the
+// already decompressed data in front of it as dictionary, so the blocks
+// are compressed in parallel but decompressed one after another.
+//
+// Format: 0xf2, uncompressed length (4 bytes), block length (4 bytes),
+// then for each block its compressed length (4 bytes) and data.
+//
+// 0xf3 is the same with an 8 byte uncompressed length, for inputs of
+// 4 GiB and more. Here the blocks of levels 9 and 10 of LZO1X, LZO1Y and
+// LZO1Z use a dictionary as above, all others are independent.
+//
+// 0xf5 is 0xf3 with a byte in front of the length of each block, which
+// is the LZO_METHOD_* of its compressor or AUTO_STORED. It is written by
+// algorithm="auto", which picks the compressor of each block, see below.
+************************************************************************/
+
+#define MT_BLOCK_LEN    (1024L * 1024L)
+#define MT_DICT_LEN     0xbfff      /* the M4 window of LZO1X */
+#define MT_HEADER_LEN   9
+#define MT_HEADER_LEN_64 13
+
+#define AUTO_STORED     0xff
+#define AUTO_SAMPLES    4           /* slices of a block that are sampled */
+#define AUTO_SAMPLE_LEN 4096
+#define AUTO_HASH_BITS  12
+
+/* the level 1 compressors that algorithm="auto" chooses from, all of
+ * which need LZO1X_1_MEM_COMPRESS */
+static const int auto_methods[] = { LZO_METHOD_LZO1X, LZO_METHOD_LZO1Y, LZO_METHOD_LZO1F };
+#define N_AUTO_METHODS  3
+
+/* Pick the compressor of a block from a sample of AUTO_SAMPLES slices.
+ * If the bytes of the sample are spread almost evenly and hardly any 4
+ * bytes of it repeat, it looks random and LZO1X is used, which skips
+ * over random data quickly and still finds repeats longer than a slice.
+ * Otherwise each candidate compresses the slices and the smallest output
+ * wins. The caller stores the block if its compressed size is no smaller.
+ */
+static int
+auto_select(const lzo_bytep in, lzo_uint in_len, lzo_voidp wrkmem)
+{
+    unsigned char out[AUTO_SAMPLE_LEN + AUTO_SAMPLE_LEN / 16 + 64 + 3];
+    lzo_uint32_t counts[256];
+    unsigned short seen[1 << AUTO_HASH_BITS];
+    lzo_uint starts[AUTO_SAMPLES];
+    lzo_uint slice_len, sample_len, matches, i;
+    lzo_uint best_len = 0;
+    int nslices, s, m, best = LZO_METHOD_LZO1X;
+    double bits;
+
+    /* no slice is longer than AUTO_SAMPLE_LEN, as out holds the
+     * compressed size of that and the compressors do not check it */
+    if (in_len <= AUTO_SAMPLE_LEN)
+    {
+        nslices = 1;
+        slice_len = in_len;
+        starts[0] = 0;
+    }
+    else
+    {
+        nslices = in_len < AUTO_SAMPLES * AUTO_SAMPLE_LEN ?
+                  (int) ((in_len + AUTO_SAMPLE_LEN - 1) / AUTO_SAMPLE_LEN) : AUTO_SAMPLES;
+        slice_len = AUTO_SAMPLE_LEN;
+        for (s = 0; s < nslices; s++)
+            starts[s] = (in_len - slice_len) / (nslices - 1) * s;
+    }
+    sample_len = nslices * slice_len;
+    if (sample_len < 16)
+        return LZO_METHOD_LZO1X;
+
+    /* order-0 entropy and the number of 4 byte repeats */
+    memset(counts, 0, sizeof(counts));
+    matches = 0;
+    for (s = 0; s < nslices; s++)
+    {
+        const lzo_bytep p = in + starts[s];
+
+        memset(seen, 0xff, sizeof(seen));
+        for (i = 0; i < slice_len; i++)
+            counts[p[i]]++;
+        for (i = 0; i + 4 <= slice_len; i++)
+        {
+            lzo_uint32_t v = (lzo_uint32_t) p[i] | ((lzo_uint32_t) p[i+1] << 8) |
+                             ((lzo_uint32_t) p[i+2] << 16) | ((lzo_uint32_t) p[i+3] << 24);
+            unsigned h = (unsigned) ((v * 0x9e3779b1u) >> (32 - AUTO_HASH_BITS));
+
+            if (seen[h] != 0xffff && memcmp(p + seen[h], p + i, 4) == 0)
+                matches++;
+            seen[h] = (unsigned short) i;
+        }
+    }
+    for (bits = 0, i = 0; i < 256; i++)
+        if (counts[i] != 0)
+            bits -= (double) counts[i] * log2((double) counts[i] / sample_len);
+    if (bits > 7.9 * sample_len && matches < sample_len / 64)
+        return LZO_METHOD_LZO1X;
+
+    for (m = 0; m < N_AUTO_METHODS; m++)
+    {
+        lzo_uint total = 0;
+
+        for (s = 0; s < nslices; s++)
+        {
+            lzo_uint l = sizeof(out);
+
+            if ((*algorithms[auto_methods[m]].compress_1)(in + starts[s], slice_len, out, &l, wrkmem) != LZO_E_OK)
+                l = slice_len;
+            total += l;
+        }
+        if (m == 0 || total < best_len)
+        {
+            best = auto_methods[m];
+            best_len = total;
+        }
+    }
+    return best;
+}
+
+/* compress a block with the compressor that auto_select() picks; out
+ * has room for lzo_compress_bound() of in_len, which is at least in_len */
+static int
+auto_compress(const lzo_bytep in, lzo_uint in_len, lzo_bytep out, lzo_uintp out_len,
+              unsigned char *method, lzo_voidp wrkmem)
+{
+    int m = auto_select(in, in_len, wrkmem);
+    lzo_uint l = *out_len;
+    int err = (*algorithms[m].compress_1)(in, in_len, out, &l, wrkmem);
+
+    if (err != LZO_E_OK)
+        return err;
+    if (l < in_len)
+    {
+        *method = (unsigned char) m;
+        *out_len = l;
+        return LZO_E_OK;
+    }
+    memcpy(out, in, in_len);
+    *method = AUTO_STORED;
+    *out_len = in_len;
+    return LZO_E_OK;
+}
+
+typedef struct {
     const lzo_bytep in;
-    lzo_bytep out;
-    lzo_bytep outc;
     lzo_uint in_len;
-    lzo_uint out_len;
-    lzo_uint new_len;
-    Py_ssize_t len;
-    int level = 1;
-    int header = 1;
+    lzo_bytep out;              /* block i is written to out + i * slot_len */
+    lzo_uint bound;             /* lzo_compress_bound() of a block */
+    lzo_uint slot_len;          /* 4 + bound, or 5 + bound with methods */
+    unsigned char *methods;     /* algorithm="auto": the choice for each block */
+    lzo_uint *out_lens;
+    lzo_uint nblocks;
+    lzo_uint next;              /* next block to compress, protected by lock */
+    lzo_compress_level_fn compress_ptr; /* with dictionary, or NULL */
+    lzo_compress_fn compress_plain_ptr;
+    lzo_optimize_src_fn optimize_ptr;   /* or NULL */
+    lzo_uint clear_len;         /* work memory cleared before each block */
+    int level;
     int err;
+    lzo_progress_t *progress;   /* or NULL */
+    PyThread_type_lock lock;
+} mt_job_t;
+
+typedef struct {
+    mt_job_t *job;
+    lzo_voidp wrkmem;
+    lzo_mem_t mem;
+    lzo_callback_t cb;
+    PyThread_type_lock done;    /* held until the worker thread exits */
+} mt_worker_t;
+
+static void
+mt_compress_blocks(mt_worker_t *w)
+{
+    mt_job_t *job = w->job;
 
-    static char* argnames[] = {"", "", "", "algorithm", NULL};
-    char *algorithm = "LZO1X";
-    lzo_compress_fn compress_1_ptr;
-    lzo_compress_fn compress_999_ptr;
-    lzo_uint32_t MEM_COMPRESS_1;
-    lzo_uint32_t MEM_COMPRESS_999;
+    for (;;)
+    {
+        lzo_uint i, start, in_len, dict_len, new_len;
+        int err;
+
+        PyThread_acquire_lock(job->lock, WAIT_LOCK);
+        i = job->next++;
+        err = job->err;
+        PyThread_release_lock(job->lock);
+        if (i >= job->nblocks || err != LZO_E_OK)
+            break;
+
+        start = i * MT_BLOCK_LEN;
+        in_len = job->in_len - start < MT_BLOCK_LEN ? job->in_len - start : MT_BLOCK_LEN;
+        dict_len = start < MT_DICT_LEN ? start : MT_DICT_LEN;
+        new_len = job->bound;
+        /* a dictionary left by the block before would make the output
+         * depend on which thread got which block */
+        if (job->clear_len > 0)
+            memset(w->wrkmem, 0, job->clear_len);
+        if (job->methods != NULL)
+            err = auto_compress(job->in + start, in_len, job->out + i * job->slot_len, &new_len,
+                                &job->methods[i], w->wrkmem);
+        else if (job->compress_ptr != NULL)
+            err = (*job->compress_ptr)(job->in + start, in_len,
+                                       job->out + i * job->slot_len, &new_len, w->wrkmem,
+                                       job->in + start - dict_len, dict_len,
+                                       progress_callback(job->progress, &w->cb), job->level);
+        else
+            err = (*job->compress_plain_ptr)(job->in + start, in_len,
+                                             job->out + i * job->slot_len, &new_len, w->wrkmem);
+        if (err == LZO_E_OK && job->optimize_ptr != NULL)
+        {
+            /* matches into the dictionary are read from in[] as well */
+            lzo_uint l = in_len;
+            err = (*job->optimize_ptr)(job->out + i * job->slot_len, new_len, job->in + start, &l, NULL);
+        }
+        job->out_lens[i] = new_len;
+        if (err != LZO_E_OK)
+        {
+            PyThread_acquire_lock(job->lock, WAIT_LOCK);
+            job->err = err;
+            PyThread_release_lock(job->lock);
+        }
+    }
+}
 
-    /* init */
-    UNUSED(dummy);
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s#|ii$s", argnames, &in, &len, &level, &header, &algorithm))
-        return NULL;
-    if (len < 0)
-        return NULL;
+static void
+mt_thread(void *arg)
+{
+    mt_worker_t *w = (mt_worker_t *) arg;
 
-    if (len > LZO_UINT_MAX) {
-      PyErr_SetString(LzoError, "Input size is larger than LZO_UINT_MAX");
+    mt_compress_blocks(w);
+    PyThread_release_lock(w->done);
+}
+
+/* Compress in[] into the block format using up to nthreads threads.
+ * method is the LZO_METHOD_* of the compressors, which sizes the blocks,
+ * or -1 for algorithm="auto", which needs wide and ignores the compressors.
+ * The caller holds the GIL, which is released while compressing. The blocks
+ * use compress_ptr with a dictionary or, if that is NULL,
+ * compress_plain_ptr without one (only allowed for the 0xf3 header), and
+ * are then optimized with optimize_ptr unless that is NULL. progress
+ * is only used by compress_ptr.
+ */
+static PyObject *
+compress_blocks(lzo_state *st, const lzo_bytep in, lzo_uint in_len, int nthreads, int wide, int method,
+                lzo_compress_level_fn compress_ptr, lzo_compress_fn compress_plain_ptr,
+                lzo_optimize_src_fn optimize_ptr, int level, lzo_uint32_t wrkmem_size,
+                lzo_progress_t *progress)
+{
+    const lzo_uint header_len = wide ? MT_HEADER_LEN_64 : MT_HEADER_LEN;
+    const lzo_uint prefix_len = method < 0 ? 5 : 4;
+    PyObject *result_str = NULL;
+    mt_job_t job;
+    mt_worker_t *workers;
+    lzo_uint i, op;
+    int t, started = 0;
+
+    if (!wide && (lzo_uint64_t) in_len > 0xffffffffUL) {
+      PyErr_SetString(st->error, "Input size is larger than 4 GiB");
       return NULL;
     }
 
-    if ((len + len / 16 + 64 + 3) > LZO_UINT_MAX) {
-      PyErr_SetString(LzoError, "Output size is larger than LZO_UINT_MAX");
-      return NULL;
+    memset(&job, 0, sizeof(job));
+    job.in = in;
+    job.in_len = in_len;
+    job.nblocks = (in_len + MT_BLOCK_LEN - 1) / MT_BLOCK_LEN;
+    job.compress_ptr = compress_ptr;
+    job.compress_plain_ptr = compress_plain_ptr;
+    job.optimize_ptr = optimize_ptr;
+    job.level = level;
+    job.progress = progress;
+    if (compress_ptr == NULL && MEM_WRKMEM_FAST(method) == MEM_WRKMEM_CLEAR)
+        job.clear_len = wrkmem_size;
+    job.bound = lzo_compress_bound(method < 0 ? LZO_METHOD_LZO1X : method, MT_BLOCK_LEN);
+    job.slot_len = prefix_len + job.bound;
+    job.err = LZO_E_OK;
+    if ((lzo_uint) nthreads > job.nblocks)
+        nthreads = job.nblocks > 0 ? (int) job.nblocks : 1;
+
+    /* alloc buffers; the blocks are compacted in place at the end */
+    result_str = PyBytes_FromStringAndSize(NULL, header_len + job.nblocks * job.slot_len);
+    workers = (mt_worker_t *) PyMem_Calloc(nthreads, sizeof(mt_worker_t));
+    job.out_lens = (lzo_uint *) PyMem_Calloc(job.nblocks + 1, sizeof(lzo_uint));
+    job.lock = PyThread_allocate_lock();
+    if (method < 0)
+        job.methods = (unsigned char *) PyMem_Calloc(job.nblocks + 1, 1);
+    if (result_str == NULL || workers == NULL || job.out_lens == NULL || job.lock == NULL ||
+        (method < 0 && job.methods == NULL))
+        goto nomem;
+    job.out = (lzo_bytep) PyBytes_AsString(result_str) + header_len + prefix_len;
+    for (t = 0; t < nthreads; t++)
+    {
+        workers[t].job = &job;
+        workers[t].wrkmem = mem_alloc(st, &workers[t].mem, wrkmem_size, MEM_WRKMEM);
+        if (workers[t].wrkmem == NULL)
+            goto error;
+    }
+
+    /* the calling thread is worker 0; if a thread cannot be started
+     * the remaining ones simply do more of the work */
+    for (t = 1; t < nthreads; t++)
+    {
+        workers[t].done = PyThread_allocate_lock();
+        if (workers[t].done == NULL)
+            break;
+        PyThread_acquire_lock(workers[t].done, WAIT_LOCK);
+        if (PyThread_start_new_thread(mt_thread, &workers[t]) == (unsigned long) -1)
+        {
+            PyThread_release_lock(workers[t].done);
+            PyThread_free_lock(workers[t].done);
+            workers[t].done = NULL;
+            break;
+        }
+        started++;
     }
 
-    /* init for different algorithms*/
-    if (strcmp(algorithm, "LZO1") == 0) {
-      // settings specific for lzo1
-      MEM_COMPRESS_1 = LZO1_MEM_COMPRESS;
-      MEM_COMPRESS_999 = LZO1_99_MEM_COMPRESS;
+    Py_BEGIN_ALLOW_THREADS
+    mt_compress_blocks(&workers[0]);
+    for (t = 1; t <= started; t++)
+        PyThread_acquire_lock(workers[t].done, WAIT_LOCK);
+    Py_END_ALLOW_THREADS
+
+    for (t = 1; t <= started; t++)
+    {
+        PyThread_release_lock(workers[t].done);
+        PyThread_free_lock(workers[t].done);
+    }
+
+    if (progress != NULL && progress_finish(st, progress, job.err) < 0)
+    {
+        Py_CLEAR(result_str);
+        goto done;
+    }
+    if (job.err != LZO_E_OK)
+    {
+        /* this should NEVER happen */
+        PyErr_Format(st->error, "Error %i while compressing data", job.err);
+        Py_CLEAR(result_str);
+        goto done;
+    }
+
+    /* write the header and move the blocks together */
+    {
+        lzo_bytep out = (lzo_bytep) PyBytes_AsString(result_str);
+
+        out[0] = method < 0 ? 0xf5 : wide ? 0xf3 : 0xf2;
+        for (op = 1, t = wide ? 56 : 24; t >= 0; t -= 8)
+            out[op++] = (unsigned char) ((((lzo_uint64_t) in_len) >> t) & 0xff);
+        out[op++] = (unsigned char) ((MT_BLOCK_LEN >> 24) & 0xff);
+        out[op++] = (unsigned char) ((MT_BLOCK_LEN >> 16) & 0xff);
+        out[op++] = (unsigned char) ((MT_BLOCK_LEN >>  8) & 0xff);
+        out[op++] = (unsigned char) ((MT_BLOCK_LEN >>  0) & 0xff);
+        for (i = 0; i < job.nblocks; i++)
+        {
+            lzo_uint l = job.out_lens[i];
+
+            if (job.methods != NULL)
+                out[op++] = job.methods[i];
+            out[op++] = (unsigned char) ((l >> 24) & 0xff);
+            out[op++] = (unsigned char) ((l >> 16) & 0xff);
+            out[op++] = (unsigned char) ((l >>  8) & 0xff);
+            out[op++] = (unsigned char) ((l >>  0) & 0xff);
+            memmove(out + op, job.out + i * job.slot_len, l);
+            op += l;
+        }
+    }
+    _PyBytes_Resize(&result_str, op);
+    goto done;
+
+nomem:
+    PyErr_NoMemory();
+error:
+    Py_CLEAR(result_str);
+done:
+    if (workers != NULL)
+    {
+        for (t = 0; t < nthreads; t++)
+            mem_free(&workers[t].mem);
+        PyMem_Free(workers);
+    }
+    PyMem_Free(job.out_lens);
+    PyMem_Free(job.methods);
+    if (job.lock != NULL)
+        PyThread_free_lock(job.lock);
+    return result_str;
+}
+
+/* Decompress the blocks that follow the 0xf2, 0xf3 or 0xf5 header.
+ * Algorithms without a dictionary decompressor only occur with 0xf3, and
+ * 0xf5 names the algorithm of each block instead of using alg.
+ */
+static PyObject *
+decompress_blocks(lzo_state *st, const lzo_bytep in, lzo_uint len, const lzo_algorithm_t *alg)
+{
+    PyObject *result_str;
+    lzo_bytep out;
+    lzo_uint64_t total;
+    lzo_uint out_len, block_len, start, ip;
+    lzo_uint header_len = in[0] == 0xf2 ? MT_HEADER_LEN : MT_HEADER_LEN_64;
+    lzo_uint prefix_len = in[0] == 0xf5 ? 5 : 4;
+    int err = LZO_E_OK;
+
+    if (len < header_len || (in[0] == 0xf2 && alg->decompress_dict == NULL))
+        goto header_error;
+    for (total = 0, ip = 1; ip < header_len - 4; ip++)
+        total = (total << 8) | in[ip];
+    block_len = ((lzo_uint)in[ip] << 24) | (in[ip+1] << 16) | (in[ip+2] << 8) | in[ip+3];
+    if (block_len == 0 || total > (lzo_uint64_t) PY_SSIZE_T_MAX)
+        goto header_error;
+    out_len = (lzo_uint) total;
+    /* every block needs at least its length field */
+    if ((out_len + block_len - 1) / block_len > (len - header_len) / prefix_len)
+        goto header_error;
+
+    result_str = PyBytes_FromStringAndSize(NULL, out_len);
+    if (result_str == NULL)
+        return PyErr_NoMemory();
+    out = (lzo_bytep) PyBytes_AsString(result_str);
+
+    Py_BEGIN_ALLOW_THREADS
+    for (ip = header_len, start = 0; start < out_len; start += block_len)
+    {
+        lzo_uint in_len, new_len, dict_len;
+        lzo_uint l = out_len - start < block_len ? out_len - start : block_len;
+        int m = -1;
+
+        if (len - ip < prefix_len)
+        {
+            err = LZO_E_INPUT_OVERRUN;
+            break;
+        }
+        if (prefix_len == 5)
+            m = in[ip++];
+        in_len = ((lzo_uint)in[ip] << 24) | (in[ip+1] << 16) | (in[ip+2] << 8) | in[ip+3];
+        ip += 4;
+        if (in_len > len - ip)
+        {
+            err = LZO_E_INPUT_OVERRUN;
+            break;
+        }
+        dict_len = start < MT_DICT_LEN ? start : MT_DICT_LEN;
+        new_len = l;
+        if (m == AUTO_STORED)
+        {
+            if (in_len != l)
+                err = LZO_E_ERROR;
+            else
+                memcpy(out + start, in + ip, l);
+        }
+        else if (m >= 0)
+        {
+            /* only what auto_compress() writes: the others include the
+             * decompressors of LZO1 and LZO1A, which trust their input */
+            if (m == LZO_METHOD_LZO1X || m == LZO_METHOD_LZO1Y || m == LZO_METHOD_LZO1F)
+                err = (*algorithms[m].decompress)(in + ip, in_len, out + start, &new_len, NULL);
+            else
+                err = LZO_E_ERROR;
+        }
+        else if (alg->decompress_dict != NULL)
+            err = (*alg->decompress_dict)(in + ip, in_len, out + start, &new_len, NULL, out + start - dict_len, dict_len);
+        else
+            err = (*alg->decompress)(in + ip, in_len, out + start, &new_len, NULL);
+        if (err == LZO_E_OK && new_len != l)
+            err = LZO_E_ERROR;
+        if (err != LZO_E_OK)
+            break;
+        ip += in_len;
+    }
+    if (err == LZO_E_OK && ip != len)
+        err = LZO_E_INPUT_NOT_CONSUMED;
+    Py_END_ALLOW_THREADS
+
+    if (err != LZO_E_OK)
+    {
+        Py_DECREF(result_str);
+        PyErr_Format(st->error, "Compressed data violation %i", err);
+        return NULL;
+    }
+    return result_str;
+
+header_error:
+    PyErr_SetString(st->error, "Header error - invalid compressed data");
+    return NULL;
+}
+
+/***********************************************************************
+// filters
+//
+// A filter rearranges the input before it is compressed, so that the
+// matcher sees the structure of arrays of numbers: "shuffle" stores the
+// first byte of every element, then the second byte and so on,
+// "bitshuffle" does the same with each bit of each byte, and "delta"
+// replaces every byte by its difference to the same byte of the previous
+// element. Bytes at the end that do not fill an element (for bitshuffle:
+// a group of 8 elements) are left as they are.
+//
+// Format: 0xf4, filter, typesize, then the filtered data compressed with
+// one of the headers above.
+//
+// The loops are written so that compilers can vectorize them; the common
+// element sizes get their own copy of the loop with a constant stride.
+// There are no SSE2/AVX2/NEON versions: a movemask based SSE2 bitshuffle
+// was no faster than what gcc -O3 makes of the plain C below (about
+// 1.4 GB/s forward and 1.1 GB/s back for typesize 8 on x64), and -O2
+// builds lose a factor of 3 with either.
+************************************************************************/
+
+#define FILTER_NONE         0
+#define FILTER_SHUFFLE      1
+#define FILTER_BITSHUFFLE   2
+#define FILTER_DELTA        3
+#define N_FILTERS           4
+#define FILTER_HEADER_LEN   3
+
+static const char *const filter_names[N_FILTERS] = { "none", "shuffle", "bitshuffle", "delta" };
+
+#define SHUFFLE_LOOP(ts) \
+    for (j = 0; j < (ts); j++) \
+        for (i = 0; i < n; i++) \
+            dst[j * n + i] = src[i * (ts) + j]
+
+#define UNSHUFFLE_LOOP(ts) \
+    for (i = 0; i < n; i++) \
+        for (j = 0; j < (ts); j++) \
+            dst[i * (ts) + j] = src[j * n + i]
+
+static void
+shuffle(const lzo_bytep src, lzo_bytep dst, lzo_uint len, unsigned ts)
+{
+    const lzo_uint n = len / ts;
+    lzo_uint i, j;
+
+    switch (ts)
+    {
+    case 2:  SHUFFLE_LOOP(2); break;
+    case 4:  SHUFFLE_LOOP(4); break;
+    case 8:  SHUFFLE_LOOP(8); break;
+    case 16: SHUFFLE_LOOP(16); break;
+    default: SHUFFLE_LOOP(ts); break;
+    }
+    memcpy(dst + n * ts, src + n * ts, len - n * ts);
+}
+
+static void
+unshuffle(const lzo_bytep src, lzo_bytep dst, lzo_uint len, unsigned ts)
+{
+    const lzo_uint n = len / ts;
+    lzo_uint i, j;
+
+    switch (ts)
+    {
+    case 2:  UNSHUFFLE_LOOP(2); break;
+    case 4:  UNSHUFFLE_LOOP(4); break;
+    case 8:  UNSHUFFLE_LOOP(8); break;
+    case 16: UNSHUFFLE_LOOP(16); break;
+    default: UNSHUFFLE_LOOP(ts); break;
+    }
+    memcpy(dst + n * ts, src + n * ts, len - n * ts);
+}
+
+/* transpose the 8x8 bit matrix whose row k is byte k of x (Hacker's
+ * Delight 7-3); this is its own inverse */
+static lzo_uint64_t
+transpose8(lzo_uint64_t x)
+{
+    lzo_uint64_t t;
+
+    t = (x ^ (x >>  7)) & LZO_UINT64_C(0x00aa00aa00aa00aa); x ^= t ^ (t <<  7);
+    t = (x ^ (x >> 14)) & LZO_UINT64_C(0x0000cccc0000cccc); x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & LZO_UINT64_C(0x00000000f0f0f0f0); x ^= t ^ (t << 28);
+    return x;
+}
+
+/* bit b of byte j of the elements 8g ... 8g+7 goes to byte g of plane
+ * j * 8 + b; each plane is n / 8 bytes long. The elements are first
+ * shuffled by bytes in chunks, so that the 8 bytes that are transposed
+ * together are next to each other. */
+#define BITSHUFFLE_CHUNK    16384
+
+static void
+bitshuffle(const lzo_bytep src, lzo_bytep dst, lzo_uint len, unsigned ts, int reverse)
+{
+    unsigned char tmp[BITSHUFFLE_CHUNK];
+    const lzo_uint groups = len / ts / 8;
+    const lzo_uint done = groups * 8 * ts;
+    const lzo_uint chunk = (BITSHUFFLE_CHUNK / ts) / 8;  /* groups per chunk */
+    lzo_uint g0, g, j;
+    int k;
+
+    for (g0 = 0; g0 < groups; g0 += chunk)
+    {
+        const lzo_uint ng = groups - g0 < chunk ? groups - g0 : chunk;
+        const lzo_uint ne = ng * 8;
+
+        if (!reverse)
+            shuffle(src + g0 * 8 * ts, tmp, ne * ts, ts);
+        for (j = 0; j < ts; j++)
+            for (g = 0; g < ng; g++)
+            {
+                lzo_bytep p = tmp + j * ne + g * 8;
+                lzo_uint64_t x = 0;
+
+                if (!reverse)
+                {
+                    for (k = 0; k < 8; k++)
+                        x |= (lzo_uint64_t) p[k] << (8 * k);
+                    x = transpose8(x);
+                    for (k = 0; k < 8; k++)
+                        dst[(j * 8 + k) * groups + g0 + g] = (unsigned char) (x >> (8 * k));
+                }
+                else
+                {
+                    for (k = 0; k < 8; k++)
+                        x |= (lzo_uint64_t) src[(j * 8 + k) * groups + g0 + g] << (8 * k);
+                    x = transpose8(x);
+                    for (k = 0; k < 8; k++)
+                        p[k] = (unsigned char) (x >> (8 * k));
+                }
+            }
+        if (reverse)
+            unshuffle(tmp, dst + g0 * 8 * ts, ne * ts, ts);
+    }
+    memcpy(dst + done, src + done, len - done);
+}
+
+static void
+delta(const lzo_bytep src, lzo_bytep dst, lzo_uint len, unsigned ts)
+{
+    lzo_uint i;
+
+    for (i = 0; i < len && i < ts; i++)
+        dst[i] = src[i];
+    for ( ; i < len; i++)
+        dst[i] = (unsigned char) (src[i] - src[i - ts]);
+}
+
+static void
+undelta(const lzo_bytep src, lzo_bytep dst, lzo_uint len, unsigned ts)
+{
+    lzo_uint i;
+
+    for (i = 0; i < len && i < ts; i++)
+        dst[i] = src[i];
+    for ( ; i < len; i++)
+        dst[i] = (unsigned char) (src[i] + dst[i - ts]);
+}
+
+static void
+apply_filter(int filter, unsigned ts, const lzo_bytep src, lzo_bytep dst, lzo_uint len, int reverse)
+{
+    switch (filter)
+    {
+    case FILTER_SHUFFLE:
+        if (reverse)
+            unshuffle(src, dst, len, ts);
+        else
+            shuffle(src, dst, len, ts);
+        break;
+    case FILTER_BITSHUFFLE:
+        bitshuffle(src, dst, len, ts, reverse);
+        break;
+    case FILTER_DELTA:
+        if (reverse)
+            undelta(src, dst, len, ts);
+        else
+            delta(src, dst, len, ts);
+        break;
+    default:
+        memcpy(dst, src, len);
+        break;
+    }
+}
+
+/* the filter argument: None or the name of a filter */
+static int
+get_filter(PyObject *obj, int *filter)
+{
+    int i;
+
+    if (obj == NULL || obj == Py_None)
+        return 1;
+    if (PyUnicode_Check(obj))
+        for (i = 0; i < N_FILTERS; i++)
+            if (PyUnicode_CompareWithASCIIString(obj, filter_names[i]) == 0)
+            {
+                *filter = i;
+                return 1;
+            }
+    PyErr_Format(PyExc_ValueError, "unknown filter %R, use one of 'shuffle', 'bitshuffle' or 'delta'", obj);
+    return 0;
+}
+
+
+/***********************************************************************
+// compress
+************************************************************************/
+
+static /* const */ char compress__doc__[] =
+"compress(string[,level[,header[,algorithm]]]) -- Compress string, returning a string "
+"containing compressed data.\n"
+"level  - Set compression level of either 1 (default) or 9. LZO1X, LZO1Y and "
+"LZO1Z also accept 10, which picks the cheapest coding of every 4 KiB "
+"window of the input, taking the literals in front of each match into "
+"account, and is much slower than 9. Level 10 finds its matches with a "
+"binary tree; levels 1 to 9 keep the hash chains of LZO 2.10 and their "
+"output does not change. LZO1B and LZO1C "
+"accept 1 to 9, 99 and 999, the compressors lzo1b_1_compress() to "
+"lzo1b_999_compress(); their best level is 999.\n"
+"header - Include metadata header for decompression in the output "
+"(default: True). With header=2 the output has a header with a 64-bit "
+"length and is written in 1 MiB blocks, which any level and algorithm "
+"can use together with threads. This is done anyway for inputs of 4 GiB "
+"and more, which the default header cannot describe.\n"
+"algorithm (keyword argument)  - can be either LZO1, LZO1A, LZO1B, LZO1C, LZO1F, LZO1X, LZO1Y, LZO1Z, LZO2A, "
+"or one of the constants lzo.LZO1, ... (default: LZO1X). 'auto' picks "
+"LZO1X, LZO1Y, LZO1F or no compression for each 1 MiB block from a sample "
+"of it, and needs level 1 and a header; decompress() needs no algorithm "
+"for its output.\n"
+"threads (keyword argument) - Compress levels 9 and 10 of LZO1X, LZO1Y and "
+"LZO1Z on up to this many threads (default: 1). The input is then split "
+"into 1 MiB blocks which are decompressed one after another, each one "
+"using the end of the previous block as dictionary. Needs a header.\n"
+"With header=2 all levels and algorithms can use threads.\n"
+"optimize (keyword argument) - Run the optimizer of LZO1X or LZO1Y over "
+"the output before returning it, like optimize() does, but without "
+"another copy of the data (default: False).\n"
+"filter (keyword argument) - Rearrange arrays of numbers before "
+"compressing them: 'shuffle' groups the bytes and 'bitshuffle' the bits "
+"of the elements by their position, 'delta' stores the difference of "
+"each byte to the one of the previous element (default: None). The "
+"filter is recorded in the header and undone by decompress().\n"
+"typesize (keyword argument) - The size of an element for filter in "
+"bytes, 1 to 255 (default: 8).\n"
+"progress (keyword argument) - A callable, which is called as "
+"progress(done, total) with the number of input bytes compressed so far "
+"about every progress_bytes bytes (default: 1 MiB) and at the end. If it "
+"raises an exception, the compression stops and the exception is passed "
+"on. The GIL is released in between. With threads it is called from the "
+"calling thread only.\n"
+"cancel (keyword argument) - An object like threading.Event; the "
+"compression stops with lzo.error when cancel.is_set() returns True, "
+"which is checked along with progress.\n"
+"timeout (keyword argument) - Stop the compression with TimeoutError "
+"after this many seconds.\n"
+"progress, cancel and timeout need level 9 or 10 of LZO1X, LZO1Y or "
+"LZO1Z.\n"
+"dictionary (keyword argument) - Preset dictionary, for example from "
+"train_dictionary(), that matches may refer to as if it came before the "
+"input. Needs level 9 or 10 of LZO1X, LZO1Y or LZO1Z, one thread and no "
+"optimize, and decompress() needs the same dictionary.\n"
+;
+
+/* compress() after the arguments are parsed; progress is NULL unless
+ * one of progress, cancel and timeout was given, dict is NULL without
+ * a dictionary */
+static PyObject *
+compress_data(lzo_state *st, const lzo_bytep in, Py_ssize_t len, int level, int header,
+              int threads, const lzo_algorithm_t *alg, lzo_optimize_src_fn optimize_ptr,
+              lzo_progress_t *progress, const lzo_bytep dict, lzo_uint dict_len)
+{
+    PyObject *result_str;
+    lzo_callback_t cb;
+    lzo_mem_t mem;
+    lzo_voidp wrkmem = NULL;
+    lzo_bytep out;
+    lzo_bytep outc;
+    lzo_uint in_len;
+    lzo_uint out_len;
+    lzo_uint new_len;
+    int err;
+
+    lzo_compress_fn compress_1_ptr;
+    lzo_compress_fn compress_999_ptr;
+    lzo_uint32_t MEM_COMPRESS_1;
+    lzo_uint32_t MEM_COMPRESS_999;
+
+    if (len > LZO_UINT_MAX) {
+      PyErr_SetString(st->error, "Input size is larger than LZO_UINT_MAX");
+      return NULL;
+    }
+
+    if (lzo_compress_bound(alg != NULL ? ALG_METHOD(alg) : LZO_METHOD_LZO1X, (lzo_uint) len) == 0) {
+      PyErr_SetString(st->error, "Output size is larger than LZO_UINT_MAX");
+      return NULL;
+    }
+    if (threads < 1) {
+      PyErr_SetString(PyExc_ValueError, "threads must be at least 1");
+      return NULL;
+    }
+
+    if (progress != NULL && (alg == NULL || alg->compress_level == NULL || level == 1)) {
+      PyErr_SetString(PyExc_ValueError, "progress, cancel and timeout need level 9 or 10 of LZO1X, LZO1Y or LZO1Z");
+      return NULL;
+    }
+    if (dict != NULL && (alg == NULL || alg->compress_level == NULL || level == 1 || threads > 1 ||
+                         optimize_ptr != NULL || header == 2 || (lzo_uint64_t) len > 0xffffffffUL)) {
+      PyErr_SetString(PyExc_ValueError, "dictionary needs level 9 or 10 of LZO1X, LZO1Y or LZO1Z, one thread and no optimize");
+      return NULL;
+    }
+
+    if (alg == NULL) {
+      // algorithm="auto" always writes the 0xf5 block format
+      if (level != 1 || !header) {
+        PyErr_SetString(PyExc_ValueError, "algorithm='auto' needs level 1 and a header");
+        return NULL;
+      }
+      return compress_blocks(st, in, (lzo_uint) len, threads, 1, -1, NULL, NULL,
+                             NULL, 0, LZO1X_1_MEM_COMPRESS, NULL);
+    }
+
+    MEM_COMPRESS_1 = alg->mem_1;
+    MEM_COMPRESS_999 = alg->mem_999;
+    compress_1_ptr = alg->compress_1;
+    compress_999_ptr = alg->compress_999;
+
+    if (level == 10 && alg->compress_10 != NULL) {
+      // level 10 writes a level 9 stream
+      MEM_COMPRESS_999 = alg->mem_10;
+      compress_999_ptr = alg->compress_10;
+    }
+    if (alg->levels != NULL) {
+      if (LEVEL_INDEX(level) < 0) {
+        PyErr_Format(PyExc_ValueError, "%s needs level 1 to 9, 99 or 999", alg->name);
+        return NULL;
+      }
+      if (level != 1) {
+        MEM_COMPRESS_999 = (lzo_uint32_t) lzo_wrkmem_size(ALG_METHOD(alg), level);
+        compress_999_ptr = alg->levels[LEVEL_INDEX(level)];
+      }
+    }
+
+    if (header == 2 || (header && (lzo_uint64_t) len > 0xffffffffUL)) {
+      // 64-bit header; the dictionary is only used by levels 9 and 10
+      if (level == 1)
+        return compress_blocks(st, in, (lzo_uint) len, threads, 1, ALG_METHOD(alg), NULL, compress_1_ptr,
+                               optimize_ptr, 0, MEM_COMPRESS_1, NULL);
+      return compress_blocks(st, in, (lzo_uint) len, threads, 1, ALG_METHOD(alg), alg->compress_level, compress_999_ptr,
+                             optimize_ptr, level == 10 ? 10 : 8, MEM_COMPRESS_999, progress);
+    }
+    if (threads > 1) {
+      if (level == 1 || alg->compress_level == NULL || !header) {
+        PyErr_SetString(PyExc_ValueError, "threads > 1 needs level 9 or 10 of LZO1X, LZO1Y or LZO1Z and a header, or header=2");
+        return NULL;
+      }
+      // level 9 is level 8 of lzo1x_999_compress_level()
+      return compress_blocks(st, in, (lzo_uint) len, threads, 0, ALG_METHOD(alg), alg->compress_level, NULL,
+                             optimize_ptr, level == 10 ? 10 : 8, MEM_COMPRESS_999, progress);
+    }
+
+    in_len = len;
+    out_len = lzo_compress_bound(ALG_METHOD(alg), in_len);
+
+    /* alloc buffers */
+    result_str = PyBytes_FromStringAndSize(NULL, 5 + out_len);
+    if (result_str == NULL)
+        return PyErr_NoMemory();
+    wrkmem = mem_alloc(st, &mem, level == 1 ? MEM_COMPRESS_1 : MEM_COMPRESS_999,
+                       level == 1 || (alg->levels != NULL && level != 999) ?
+                       MEM_WRKMEM_FAST(ALG_METHOD(alg)) : MEM_WRKMEM);
+    if (wrkmem == NULL)
+    {
+        Py_DECREF(result_str);
+        return NULL;
+    }
+
+    /* compress */
+    out = (lzo_bytep) PyBytes_AsString(result_str);
+
+    Py_BEGIN_ALLOW_THREADS
+    outc = header ? out+5 : out; // leave space for header if needed
+    new_len = out_len;
+    if (level == 1)
+    {
+        if (header)
+            out[0] = 0xf0;
+        err = (*compress_1_ptr)(in, in_len, outc, &new_len, wrkmem);
+    }
+    else
+    {
+        if (header)
+            out[0] = 0xf1;
+        if (progress != NULL || dict != NULL)
+            err = (*alg->compress_level)(in, in_len, outc, &new_len, wrkmem, dict, dict_len,
+                                         progress != NULL ? progress_callback(progress, &cb) : NULL,
+                                         level == 10 ? 10 : 8);
+        else
+            err = (*compress_999_ptr)(in, in_len, outc, &new_len, wrkmem);
+    }
+    if (err == LZO_E_OK && optimize_ptr != NULL)
+    {
+        /* the input is what the output decompresses to */
+        lzo_uint l = in_len;
+        err = (*optimize_ptr)(outc, new_len, in, &l, NULL);
+    }
+    Py_END_ALLOW_THREADS
+
+    mem_free(&mem);
+    if (progress != NULL && progress_finish(st, progress, err) < 0)
+    {
+        Py_DECREF(result_str);
+        return NULL;
+    }
+    if (err != LZO_E_OK || new_len > out_len)
+    {
+        /* this should NEVER happen */
+        Py_DECREF(result_str);
+        PyErr_Format(st->error, "Error %i while compressing data", err);
+        return NULL;
+    }
+
+    if (header) {
+        /* save uncompressed length */
+        out[1] = (unsigned char) ((in_len >> 24) & 0xff);
+        out[2] = (unsigned char) ((in_len >> 16) & 0xff);
+        out[3] = (unsigned char) ((in_len >>  8) & 0xff);
+        out[4] = (unsigned char) ((in_len >>  0) & 0xff);
+    }
+
+    /* return */
+    if (new_len != out_len)
+        _PyBytes_Resize(&result_str, header ? new_len + 5 : new_len);
+
+    return result_str;
+}
+
+static PyObject *
+compress(PyObject *module, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
+{
+    lzo_state *st = get_lzo_state(module);
+    PyObject *result_str;
+    const lzo_bytep in;
+    lzo_bytep filtered;
+    lzo_bytep out;
+    Py_ssize_t len, out_len;
+    int level = 1;
+    int header = 1;
+    int threads = 1;
+    int optimize = 0;
+    int filter = FILTER_NONE;
+    int typesize = 8;
+    Py_ssize_t progress_bytes = PROGRESS_STEP;
+    double timeout = 0;
+
+    PyObject *pos[3], *kw[10];
+    PyObject *kwlist[10];
+    const lzo_bytep dict = NULL;
+    Py_ssize_t dict_len = 0;
+    lzo_optimize_src_fn optimize_ptr = NULL;
+    const lzo_algorithm_t *alg;
+    lzo_progress_t progress;
+    lzo_progress_t *progress_ptr = NULL;
+    lzo_mem_t mem;
+    int i;
+
+    /* init */
+    kwlist[0] = st->str_algorithm;
+    kwlist[1] = st->str_threads;
+    kwlist[2] = st->str_optimize;
+    kwlist[3] = st->str_filter;
+    kwlist[4] = st->str_typesize;
+    kwlist[5] = st->str_progress;
+    kwlist[6] = st->str_progress_bytes;
+    kwlist[7] = st->str_cancel;
+    kwlist[8] = st->str_timeout;
+    kwlist[9] = st->str_dictionary;
+    if (!parse_args("compress", args, nargs, kwnames, 3, pos, 10, kwlist, kw))
+        return NULL;
+    if (kw[9] != NULL && kw[9] != Py_None && !get_data(kw[9], &dict, &dict_len))
+        return NULL;
+    if (!get_data(pos[0], &in, &len) || !get_int(pos[1], &level) || !get_int(pos[2], &header) ||
+        !get_int(kw[1], &threads) || !get_filter(kw[3], &filter) || !get_int(kw[4], &typesize))
+        return NULL;
+    if (kw[2] != NULL && (optimize = PyObject_IsTrue(kw[2])) < 0)
+        return NULL;
+    alg = is_auto(kw[0]) ? NULL : get_algorithm(st, kw[0]);
+    if (alg == NULL && PyErr_Occurred())
+        return NULL;
+    if (optimize) {
+      if (alg == NULL || alg->optimize_src == NULL) {
+        PyErr_SetString(PyExc_ValueError, "optimize needs LZO1X or LZO1Y");
+        return NULL;
+      }
+      optimize_ptr = alg->optimize_src;
+    }
+    if (len < 0)
+        return NULL;
+
+    for (i = 5; i < 9; i++)
+        if (kw[i] == Py_None)
+            kw[i] = NULL;
+    if (kw[5] != NULL || kw[7] != NULL || kw[8] != NULL) {
+      if (kw[5] != NULL && !PyCallable_Check(kw[5])) {
+        PyErr_SetString(PyExc_TypeError, "progress must be callable");
+        return NULL;
+      }
+      if (kw[7] != NULL && !PyObject_HasAttrString(kw[7], "is_set")) {
+        PyErr_SetString(PyExc_TypeError, "cancel must have an is_set() method");
+        return NULL;
+      }
+      if (kw[6] != NULL && !PyArg_Parse(kw[6], "n", &progress_bytes))
+        return NULL;
+      if (kw[8] != NULL && (timeout = PyFloat_AsDouble(kw[8])) == -1.0 && PyErr_Occurred())
+        return NULL;
+      if (progress_bytes < 1 || (kw[8] != NULL && !(timeout > 0))) {
+        PyErr_SetString(PyExc_ValueError, "progress_bytes and timeout must be positive");
+        return NULL;
+      }
+      memset(&progress, 0, sizeof(progress));
+      progress.progress = kw[5];
+      progress.cancel = kw[7];
+      progress.deadline = kw[8] != NULL ? progress_clock() + timeout : 0;
+      progress.total = (lzo_uint64_t) len;
+      progress.step = (lzo_uint64_t) progress_bytes;
+      progress.next = progress.step;
+      progress.tstate = PyThreadState_Get();
+      progress.owner = PyThread_get_thread_ident();
+      progress.lock = PyThread_allocate_lock();
+      if (progress.lock == NULL)
+        return PyErr_NoMemory();
+      progress_ptr = &progress;
+    }
+
+    if (filter == FILTER_NONE) {
+      result_str = compress_data(st, in, len, level, header, threads, alg, optimize_ptr, progress_ptr,
+                               dict, (lzo_uint) dict_len);
+      goto done;
+    }
+
+    result_str = NULL;
+    if (!header) {
+      PyErr_SetString(PyExc_ValueError, "filter needs a header");
+      goto done;
+    }
+    if (typesize < 1 || typesize > 255) {
+      PyErr_SetString(PyExc_ValueError, "typesize must be between 1 and 255");
+      goto done;
+    }
+    filtered = (lzo_bytep) mem_alloc(st, &mem, len > 0 ? len : 1, MEM_SCRATCH);
+    if (filtered == NULL)
+      goto done;
+    Py_BEGIN_ALLOW_THREADS
+    apply_filter(filter, typesize, in, filtered, len, 0);
+    Py_END_ALLOW_THREADS
+    result_str = compress_data(st, filtered, len, level, header, threads, alg, optimize_ptr, progress_ptr,
+                               dict, (lzo_uint) dict_len);
+    mem_free(&mem);
+    if (result_str == NULL)
+        goto done;
+
+    /* put the filter in front of the header */
+    out_len = PyBytes_GET_SIZE(result_str);
+    if (_PyBytes_Resize(&result_str, FILTER_HEADER_LEN + out_len) < 0)
+        goto done;
+    out = (lzo_bytep) PyBytes_AS_STRING(result_str);
+    memmove(out + FILTER_HEADER_LEN, out, out_len);
+    out[0] = 0xf4;
+    out[1] = (unsigned char) filter;
+    out[2] = (unsigned char) typesize;
+
+done:
+    if (progress_ptr != NULL)
+        progress_free(progress_ptr);
+    return result_str;
+}
+
+
+/***********************************************************************
+// compress_bound
+************************************************************************/
+
+static /* const */ char compress_bound__doc__[] =
+"compress_bound(n[,header[,algorithm]]) -- Return the largest size that "
+"compress() can return for n bytes of input, with any level, number of "
+"threads and filter.\n"
+"header - As for compress() (default: True).\n"
+"algorithm (keyword argument) - As for compress() (default: LZO1X).\n"
+;
+
+/* size of the block format for in_len bytes, or 0 on overflow; method
+ * is -1 for algorithm="auto" as in compress_blocks() */
+static lzo_uint64_t
+blocks_bound(int method, lzo_uint64_t in_len, lzo_uint header_len)
+{
+    const lzo_uint prefix_len = method < 0 ? 5 : 4;
+    lzo_uint64_t full = in_len / MT_BLOCK_LEN;
+    lzo_uint rest = (lzo_uint) (in_len % MT_BLOCK_LEN);
+    lzo_uint64_t total;
+
+    if (method < 0)
+        method = LZO_METHOD_LZO1X;
+    total = header_len + full * (prefix_len + lzo_compress_bound(method, MT_BLOCK_LEN));
+    if (rest > 0)
+        total += prefix_len + lzo_compress_bound(method, rest);
+    return total > (lzo_uint64_t) PY_SSIZE_T_MAX ? 0 : total;
+}
+
+static PyObject *
+compress_bound(PyObject *module, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
+{
+    lzo_state *st = get_lzo_state(module);
+    PyObject *pos[2], *kw[1];
+    PyObject *kwlist[1];
+    const lzo_algorithm_t *alg;
+    Py_ssize_t n;
+    int header = 1;
+    lzo_uint64_t bound;
+
+    kwlist[0] = st->str_algorithm;
+    if (!parse_args("compress_bound", args, nargs, kwnames, 2, pos, 1, kwlist, kw))
+        return NULL;
+    if (!PyArg_Parse(pos[0], "n", &n) || !get_int(pos[1], &header))
+        return NULL;
+    alg = is_auto(kw[0]) ? NULL : get_algorithm(st, kw[0]);
+    if (alg == NULL && PyErr_Occurred())
+        return NULL;
+    if (n < 0) {
+        PyErr_SetString(PyExc_ValueError, "n must not be negative");
+        return NULL;
+    }
+
+    if (alg == NULL && !header) {
+        PyErr_SetString(PyExc_ValueError, "algorithm='auto' needs a header");
+        return NULL;
+    }
+    if (alg == NULL)
+        bound = blocks_bound(-1, n, MT_HEADER_LEN_64);
+    else if (header == 2 || (header && (lzo_uint64_t) n > 0xffffffffUL))
+        bound = blocks_bound(ALG_METHOD(alg), n, MT_HEADER_LEN_64);
+    else {
+        bound = lzo_compress_bound(ALG_METHOD(alg), (lzo_uint) n);
+        if (bound != 0 && header) {
+            /* threads > 1 write the 0xf2 block format */
+            lzo_uint64_t b = blocks_bound(ALG_METHOD(alg), n, MT_HEADER_LEN);
+            bound = b == 0 ? 0 : b > bound + 5 ? b : bound + 5;
+        }
+    }
+    if (bound != 0 && header)
+        bound += FILTER_HEADER_LEN;
+    if (bound == 0 || bound > (lzo_uint64_t) PY_SSIZE_T_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "compressed size out of range");
+        return NULL;
+    }
+    return PyLong_FromSsize_t((Py_ssize_t) bound);
+}
+
+
+/***********************************************************************
+// decompress
+************************************************************************/
+
+static /* const */ char decompress__doc__[] =
+"decompress(string[,header[,buflen[,algorithm]]]) -- Decompress the data in string, returning a string containing the decompressed data.\n"
+"header - Metadata header is included in input (default: True).\n"
+"buflen - If header is False, a buffer length in bytes must be given that "
+"will fit the output.\n"
+"algorithm (keyword argument) - can be either LZO1, LZO1A, LZO1B, LZO1C, LZO1F, LZO1X, LZO1Y, LZO1Z, LZO2A, "
+"or one of the constants lzo.LZO1, ... (default: LZO1X).\n"
+"dictionary (keyword argument) - The preset dictionary the data was "
+"compressed with, if any.\n"
+"Data compressed with threads > 1, header=2, algorithm='auto' or a filter "
+"is recognized by its header.\n"
+;
+
+/* decompress() after the arguments are parsed, except for filters */
+static PyObject *
+decompress_data(lzo_state *st, const lzo_bytep in, Py_ssize_t len, int header, int buflen,
+                const lzo_algorithm_t *alg, const lzo_bytep dict, lzo_uint dict_len)
+{
+    PyObject *result_str;
+    lzo_bytep out;
+    lzo_uint in_len;
+    lzo_uint out_len;
+    lzo_uint new_len;
+    int err;
+
+    if (dict != NULL && (alg->decompress_dict == NULL ||
+                         (header && len > 0 && (in[0] == 0xf2 || in[0] == 0xf3 || in[0] == 0xf5)))) {
+        PyErr_SetString(PyExc_ValueError, "dictionary needs LZO1X, LZO1Y or LZO1Z data written by one thread");
+        return NULL;
+    }
+    if (header && len > 0 && (in[0] == 0xf2 || in[0] == 0xf3 || in[0] == 0xf5))
+        return decompress_blocks(st, in, len, alg);
+    if (header) {
+        if (len < 5 + 3 || in[0] < 0xf0 || in[0] > 0xf1)
+            goto header_error;
+        out_len = ((lzo_uint)in[1] << 24) | (in[2] << 16) | (in[3] << 8) | in[4];
+        in_len = len - 5;
+        in += 5;
+    }
+    else {
+        if (buflen < 0) return PyErr_Format(st->error, "Argument buflen required for headerless decompression");
+        out_len = buflen;
+        in_len = len;
+    }
+
+    /* alloc buffers */
+    result_str = PyBytes_FromStringAndSize(NULL, out_len);
+    if (result_str == NULL)
+        return PyErr_NoMemory();
+
+    /* decompress */
+    out = (lzo_bytep) PyBytes_AsString(result_str);
+
+    Py_BEGIN_ALLOW_THREADS
+    new_len = out_len;
+    if (dict != NULL)
+        err = (*alg->decompress_dict)(in, in_len, out, &new_len, NULL, dict, dict_len);
+    else
+        err = (*alg->decompress)(in, in_len, out, &new_len, NULL);
+    Py_END_ALLOW_THREADS
+
+    if (err != LZO_E_OK || (header && new_len != out_len) )
+    {
+        Py_DECREF(result_str);
+        PyErr_Format(st->error, "Compressed data violation %i", err);
+        return NULL;
+    }
+
+    if (!header && new_len != out_len)
+        _PyBytes_Resize(&result_str, new_len);
+
+    /* success */
+    return result_str;
+
+header_error:
+    PyErr_SetString(st->error, "Header error - invalid compressed data");
+    return NULL;
+}
+
+static PyObject *
+decompress(PyObject *module, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
+{
+    lzo_state *st = get_lzo_state(module);
+    PyObject *inner, *result_str;
+    const lzo_bytep in;
+    Py_ssize_t len, out_len;
+    int buflen = -1;
+    int header = 1;
+    int filter, typesize;
+
+    PyObject *pos[3], *kw[2];
+    PyObject *kwlist[2];
+    const lzo_algorithm_t *alg;
+    const lzo_bytep dict = NULL;
+    Py_ssize_t dict_len = 0;
+
+    /* init */
+    kwlist[0] = st->str_algorithm;
+    kwlist[1] = st->str_dictionary;
+    if (!parse_args("decompress", args, nargs, kwnames, 3, pos, 2, kwlist, kw))
+        return NULL;
+    if (!get_data(pos[0], &in, &len) || !get_int(pos[1], &header) || !get_int(pos[2], &buflen))
+        return NULL;
+    if (kw[1] != NULL && kw[1] != Py_None && !get_data(kw[1], &dict, &dict_len))
+        return NULL;
+    if (is_auto(kw[0])) {
+        PyErr_SetString(PyExc_ValueError, "algorithm=\"auto\" is only for compress(); decompress() reads it from the header");
+        return NULL;
+    }
+    alg = get_algorithm(st, kw[0]);
+    if (alg == NULL)
+        return NULL;
+    if (!header || len == 0 || in[0] != 0xf4)
+        return decompress_data(st, in, len, header, buflen, alg, dict, (lzo_uint) dict_len);
+
+    /* filtered */
+    if (len < FILTER_HEADER_LEN || in[1] == FILTER_NONE || in[1] >= N_FILTERS || in[2] == 0)
+    {
+        PyErr_SetString(st->error, "Header error - invalid compressed data");
+        return NULL;
+    }
+    filter = in[1];
+    typesize = in[2];
+    inner = decompress_data(st, in + FILTER_HEADER_LEN, len - FILTER_HEADER_LEN, 1, -1, alg,
+                            dict, (lzo_uint) dict_len);
+    if (inner == NULL)
+        return NULL;
+    out_len = PyBytes_GET_SIZE(inner);
+    result_str = PyBytes_FromStringAndSize(NULL, out_len);
+    if (result_str == NULL)
+    {
+        Py_DECREF(inner);
+        return PyErr_NoMemory();
+    }
+    Py_BEGIN_ALLOW_THREADS
+    apply_filter(filter, typesize, (const lzo_bytep) PyBytes_AS_STRING(inner),
+                 (lzo_bytep) PyBytes_AS_STRING(result_str), out_len, 1);
+    Py_END_ALLOW_THREADS
+    Py_DECREF(inner);
+    return result_str;
+}
+
+
+/***********************************************************************
+// decompress_inplace
+************************************************************************/
+
+static /* const */ char decompress_inplace__doc__[] =
+"decompress_inplace(buffer, n[,header[,buflen]]) -- Decompress LZO1X data "
+"that is stored in the last n bytes of a writable buffer, such as a "
+"bytearray, to the start of the same buffer, and return the length of the "
+"decompressed data.\n"
+"The buffer must hold the decompressed data plus a margin of "
+"len // 16 + 64 + 3 bytes, see inplace_size().\n"
+"header - Metadata header is included in input (default: True).\n"
+"buflen - If header is False, the length of the decompressed data (or an "
+"upper bound) must be given.\n"
+;
+
+static PyObject *
+decompress_inplace(PyObject *module, PyObject *args)
+{
+    lzo_state *st = get_lzo_state(module);
+    Py_buffer view;
+    lzo_bytep buf;
+    lzo_uint in_len;
+    lzo_uint out_len;
+    lzo_uint new_len;
+    Py_ssize_t n;
+    int buflen = -1;
+    int header = 1;
+    int err;
+
+    /* init */
+    if (!PyArg_ParseTuple(args, "w*n|ii", &view, &n, &header, &buflen))
+        return NULL;
+    buf = (lzo_bytep) view.buf;
+    if (n < 0 || n > view.len) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "n must be between 0 and the length of the buffer");
+        return NULL;
+    }
+    in_len = n;
+    if (header) {
+        const lzo_bytep in = buf + view.len - n;
+
+        if (n < 5 + 3 || in[0] < 0xf0 || in[0] > 0xf1)
+            goto header_error;
+        out_len = ((lzo_uint)in[1] << 24) | (in[2] << 16) | (in[3] << 8) | in[4];
+        in_len -= 5;
+        if (in_len > lzo_compress_bound(LZO_METHOD_LZO1X, out_len))
+            goto header_error;
+    }
+    else {
+        if (buflen < 0) {
+            PyBuffer_Release(&view);
+            return PyErr_Format(st->error, "Argument buflen required for headerless decompression");
+        }
+        out_len = buflen;
+    }
+    if ((lzo_uint) view.len < out_len + LZO1X_DECOMPRESS_INPLACE_MARGIN(out_len)) {
+        PyBuffer_Release(&view);
+        return PyErr_Format(PyExc_ValueError, "buffer too small for in-place decompression, need %zd bytes",
+                            (Py_ssize_t) (out_len + LZO1X_DECOMPRESS_INPLACE_MARGIN(out_len)));
+    }
+
+    /* decompress; the header is simply left in front of the data */
+    Py_BEGIN_ALLOW_THREADS
+    new_len = out_len;
+    err = lzo1x_decompress_inplace(buf, view.len, in_len, &new_len, NULL);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&view);
+    if (err != LZO_E_OK || (header && new_len != out_len))
+        return PyErr_Format(st->error, "Compressed data violation %i", err);
+
+    /* success */
+    return PyLong_FromSize_t(new_len);
+
+header_error:
+    PyBuffer_Release(&view);
+    PyErr_SetString(st->error, "Header error - invalid compressed data");
+    return NULL;
+}
+
+static /* const */ char inplace_size__doc__[] =
+"inplace_size(n) -- Return the size of the buffer that decompress_inplace() "
+"needs for n bytes of decompressed data.\n"
+;
+
+static PyObject *
+inplace_size(PyObject *dummy, PyObject *args)
+{
+    Py_ssize_t n;
+
+    UNUSED(dummy);
+    if (!PyArg_ParseTuple(args, "n", &n))
+        return NULL;
+    if (n < 0 || (size_t) n > (size_t) PY_SSIZE_T_MAX - LZO1X_DECOMPRESS_INPLACE_MARGIN((size_t) n)) {
+        PyErr_SetString(PyExc_ValueError, "size out of range");
+        return NULL;
+    }
+    return PyLong_FromSsize_t(n + LZO1X_DECOMPRESS_INPLACE_MARGIN(n));
+}
+
+
+/***********************************************************************
+// optimize
+************************************************************************/
+
+/* Optimize the compressed data in buf[] in place. If src is not NULL the
+ * data is first copied from there, which is done without the GIL like
+ * the rest of the work. Returns 0, or -1 with an exception set.
+ */
+static int
+optimize_buffer(lzo_state *st, lzo_bytep buf, const lzo_bytep src, Py_ssize_t len, int header, int buflen)
+{
+    const lzo_bytep in = src != NULL ? src : buf;
+    lzo_bytep out;
+    lzo_uint in_len;
+    lzo_uint out_len;
+    lzo_uint new_len;
+    int err;
+
+    if (header) {
+        if (len < 5 + 3 || in[0] < 0xf0 || in[0] > 0xf1)
+            goto header_error;
+        in_len = len - 5;
+        out_len = (in[1] << 24) | (in[2] << 16) | (in[3] << 8) | in[4];
+        if ((int)out_len < 0 || in_len > out_len + out_len / 64 + 16 + 3)
+            goto header_error;
+    }
+    else {
+        if (buflen < 0) {
+            PyErr_Format(st->error, "Argument buflen required for headerless optimization");
+            return -1;
+        }
+        out_len = buflen;
+        in_len = len;
+    }
+
+    /* lzo1x_optimize_src() would need the uncompressed data, which only
+     * compress(optimize=True) has; here it is decompressed alongside into
+     * a scratch buffer of out_len bytes */
+    Py_BEGIN_ALLOW_THREADS
+    out = (lzo_bytep) PyMem_RawMalloc(out_len > 0 ? out_len : 1);
+    err = LZO_E_OUT_OF_MEMORY;
+    if (out != NULL)
+    {
+        if (src != NULL)
+            memcpy(buf, src, len);
+        new_len = out_len;
+        err = lzo1x_optimize(header ? buf+5 : buf, in_len, out, &new_len, NULL);
+        PyMem_RawFree(out);
+    }
+    Py_END_ALLOW_THREADS
+
+    if (err == LZO_E_OUT_OF_MEMORY)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (err != LZO_E_OK || (header && new_len != out_len))
+    {
+        PyErr_Format(st->error, "Compressed data violation %i", err);
+        return -1;
+    }
+    return 0;
+
+header_error:
+    PyErr_SetString(st->error, "Header error - invalid compressed data");
+    return -1;
+}
+
+static /* const */ char optimize__doc__[] =
+"optimize(string[,header[,buflen]]) -- Optimize the representation of the "
+"compressed data, returning a string containing the compressed data.\n"
+"header - Metadata header is included in input (default: True).\n"
+"buflen - If header is False, a buffer length in bytes must be given that "
+"will fit the input/output.\n"
+"The optimizer reads the matches from the uncompressed data, so this "
+"decompresses into a scratch buffer of the uncompressed size, and the "
+"input is copied into the result first. optimize_into() saves the copy, "
+"and compress(..., optimize=True) both, as it still has the uncompressed "
+"data.\n"
+;
+
+static PyObject *
+optimize(PyObject *module, PyObject *args)
+{
+    lzo_state *st = get_lzo_state(module);
+    PyObject *result_str;
+    const lzo_bytep in;
+    Py_ssize_t len;
+    int header = 1;
+    int buflen = -1;
+
+    /* init */
+    if (!PyArg_ParseTuple(args, "s#|ii", &in, &len, &header, &buflen))
+        return NULL;
+
+    /* alloc buffers */
+    result_str = PyBytes_FromStringAndSize(NULL, len);
+    if (result_str == NULL)
+        return PyErr_NoMemory();
+
+    /* optimize */
+    if (optimize_buffer(st, (lzo_bytep) PyBytes_AsString(result_str), in, len, header, buflen) < 0)
+    {
+        Py_DECREF(result_str);
+        return NULL;
+    }
+
+    /* success */
+    return result_str;
+}
+
+
+/***********************************************************************
+// optimize_into
+************************************************************************/
+
+static /* const */ char optimize_into__doc__[] =
+"optimize_into(buffer[,header[,buflen]]) -- Optimize the compressed data in "
+"a writable buffer, such as a bytearray, in place. The length of the data "
+"does not change. The arguments are the same as for optimize(), and so is "
+"the scratch buffer of the uncompressed size.\n"
+;
 
-      compress_1_ptr = &lzo1_compress;
-      compress_999_ptr = &lzo1_99_compress;
-    }
-    else if (strcmp(algorithm, "LZO1A") == 0){
-      // settings for LZO1A
-      MEM_COMPRESS_1 = LZO1A_MEM_COMPRESS;
-      MEM_COMPRESS_999 = LZO1A_99_MEM_COMPRESS;
+static PyObject *
+optimize_into(PyObject *module, PyObject *args)
+{
+    lzo_state *st = get_lzo_state(module);
+    Py_buffer view;
+    int header = 1;
+    int buflen = -1;
+    int r;
 
-      compress_1_ptr = &lzo1a_compress;
-      compress_999_ptr = &lzo1a_99_compress;
-    }
-    else if (strcmp(algorithm, "LZO1B") == 0){
-      // settings for LZO1B
-      MEM_COMPRESS_1 = LZO1B_MEM_COMPRESS;
-      MEM_COMPRESS_999 = LZO1B_999_MEM_COMPRESS;
+    /* init */
+    if (!PyArg_ParseTuple(args, "w*|ii", &view, &header, &buflen))
+        return NULL;
 
-      compress_1_ptr = &lzo1b_1_compress;
-      compress_999_ptr = &lzo1b_999_compress;
-    }
-    else if (strcmp(algorithm, "LZO1C") == 0){
-      // settings for LZO1C
-      MEM_COMPRESS_1 = LZO1C_MEM_COMPRESS;
-      MEM_COMPRESS_999 = LZO1C_999_MEM_COMPRESS;
+    /* optimize */
+    r = optimize_buffer(st, (lzo_bytep) view.buf, NULL, view.len, header, buflen);
+    PyBuffer_Release(&view);
+    if (r < 0)
+        return NULL;
 
-      compress_1_ptr = &lzo1c_1_compress;
-      compress_999_ptr = &lzo1c_999_compress;
-    }
-    else if (strcmp(algorithm, "LZO1F") == 0){
-      // settings for LZO1F
-      MEM_COMPRESS_1 = LZO1F_MEM_COMPRESS;
-      MEM_COMPRESS_999 = LZO1F_999_MEM_COMPRESS;
+    /* success */
+    Py_RETURN_NONE;
+}
 
-      compress_1_ptr = &lzo1f_1_compress;
-      compress_999_ptr = &lzo1f_999_compress;
-    }
-    else if (strcmp(algorithm, "LZO1Y") == 0){
-      // settings for LZO1Y
-      MEM_COMPRESS_1 = LZO1Y_MEM_COMPRESS;
-      MEM_COMPRESS_999 = LZO1Y_999_MEM_COMPRESS;
 
-      compress_1_ptr = &lzo1y_1_compress;
-      compress_999_ptr = &lzo1y_999_compress;
-    }
-    else if (strcmp(algorithm, "LZO1Z") == 0){
-      // settings for LZO1Z
-      MEM_COMPRESS_1 = LZO1Z_999_MEM_COMPRESS;
-      MEM_COMPRESS_999 = LZO1Z_999_MEM_COMPRESS;
+/***********************************************************************
+// train_dictionary
+************************************************************************/
 
-      compress_1_ptr = &lzo1z_999_compress;
-      compress_999_ptr = &lzo1z_999_compress;
-    }
-    else if (strcmp(algorithm, "LZO2A") == 0){
-      // settings for LZO2A
-      MEM_COMPRESS_1 = LZO2A_999_MEM_COMPRESS;
-      MEM_COMPRESS_999 = LZO2A_999_MEM_COMPRESS;
+static /* const */ char train_dictionary__doc__[] =
+"train_dictionary(samples[,size]) -- Build a preset dictionary for LZO1X-999 "
+"from a sequence of sample strings, returning a string.\n"
+"size - Maximum size of the dictionary in bytes (default and maximum: 49151, "
+"the LZO1X M4 window).\n"
+"Pass it to compress() and decompress() as dictionary.\n"
+;
 
-      compress_1_ptr = &lzo2a_999_compress;
-      compress_999_ptr = &lzo2a_999_compress;
-    }
-    else {
-      // settings for LZO1X
-      MEM_COMPRESS_1 = LZO1X_1_MEM_COMPRESS;
-      MEM_COMPRESS_999 = LZO1X_999_MEM_COMPRESS;
+static PyObject *
+train_dictionary(PyObject *module, PyObject *args)
+{
+    lzo_state *st = get_lzo_state(module);
+    PyObject *samples;
+    PyObject *seq;
+    PyObject *result_str;
+    lzo_bytep buf = NULL;
+    lzo_uint *lens = NULL;
+    lzo_voidp wrkmem = NULL;
+    lzo_mem_t mem;
+    lzo_uint dict_len;
+    Py_ssize_t size = 0xbfff;
+    Py_ssize_t n, i;
+    Py_ssize_t total = 0;
+    int err;
 
-      compress_1_ptr = &lzo1x_1_compress;
-      compress_999_ptr = &lzo1x_999_compress;
+    /* init */
+    if (!PyArg_ParseTuple(args, "O|n", &samples, &size))
+        return NULL;
+    if (size < 0 || size > 0xbfff) {
+        PyErr_SetString(PyExc_ValueError, "size must be between 0 and 49151");
+        return NULL;
+    }
+    /* take a copy of a list, another thread could change it meanwhile */
+    if (PyList_Check(samples))
+        seq = PyList_AsTuple(samples);
+    else
+        seq = PySequence_Fast(samples, "samples must be a sequence of bytes-like objects");
+    if (seq == NULL)
+        return NULL;
+    n = PySequence_Fast_GET_SIZE(seq);
+
+    /* gather the samples into one buffer */
+    lens = (lzo_uint *) PyMem_Malloc((n > 0 ? n : 1) * sizeof(lzo_uint));
+    if (lens == NULL)
+        goto nomem;
+    for (i = 0; i < n; i++) {
+        Py_buffer view;
+        lzo_bytep p;
+
+        if (PyObject_GetBuffer(PySequence_Fast_GET_ITEM(seq, i), &view, PyBUF_SIMPLE) < 0)
+            goto error;
+        p = (lzo_bytep) PyMem_Realloc(buf, (total + view.len) > 0 ? total + view.len : 1);
+        if (p == NULL) {
+            PyBuffer_Release(&view);
+            goto nomem;
+        }
+        buf = p;
+        memcpy(buf + total, view.buf, view.len);
+        lens[i] = (lzo_uint) view.len;
+        total += view.len;
+        PyBuffer_Release(&view);
     }
-
-    in_len = len;
-    out_len = in_len + in_len / 16 + 64 + 3;
 
     /* alloc buffers */
-    result_str = PyBytes_FromStringAndSize(NULL, 5 + out_len);
+    result_str = PyBytes_FromStringAndSize(NULL, size);
     if (result_str == NULL)
-        return PyErr_NoMemory();
-    if (level == 1)
-        wrkmem = (lzo_voidp) PyMem_Malloc(MEM_COMPRESS_1);
-    else
-        wrkmem = (lzo_voidp) PyMem_Malloc(MEM_COMPRESS_999);
-    if (wrkmem == NULL)
-    {
+        goto error;
+    wrkmem = mem_alloc(st, &mem, LZO1X_TRAIN_DICT_MEM, MEM_WRKMEM);
+    if (wrkmem == NULL) {
         Py_DECREF(result_str);
-        return PyErr_NoMemory();
+        goto error;
     }
 
-    /* compress */
-    out = (lzo_bytep) PyBytes_AsString(result_str);
-
+    /* train */
     Py_BEGIN_ALLOW_THREADS
-    outc = header ? out+5 : out; // leave space for header if needed
-    new_len = out_len;
-    if (level == 1)
-    {
-        if (header)
-            out[0] = 0xf0;
-        err = (*compress_1_ptr)(in, in_len, outc, &new_len, wrkmem);
-    }
-    else
-    {
-        if (header)
-            out[0] = 0xf1;
-        err = (*compress_999_ptr)(in, in_len, outc, &new_len, wrkmem);
-    }
+    dict_len = (lzo_uint) size;
+    err = lzo1x_train_dict(buf, lens, (lzo_uint) n,
+                           (lzo_bytep) PyBytes_AsString(result_str), &dict_len, wrkmem);
     Py_END_ALLOW_THREADS
 
-    PyMem_Free(wrkmem);
-    if (err != LZO_E_OK || new_len > out_len)
+    mem_free(&mem);
+    PyMem_Free(lens);
+    PyMem_Free(buf);
+    Py_DECREF(seq);
+    if (err != LZO_E_OK)
     {
-        /* this should NEVER happen */
         Py_DECREF(result_str);
-        PyErr_Format(LzoError, "Error %i while compressing data", err);
+        PyErr_Format(st->error, "Error %i while training dictionary", err);
         return NULL;
     }
 
-    if (header) {
-        /* save uncompressed length */
-        out[1] = (unsigned char) ((in_len >> 24) & 0xff);
-        out[2] = (unsigned char) ((in_len >> 16) & 0xff);
-        out[3] = (unsigned char) ((in_len >>  8) & 0xff);
-        out[4] = (unsigned char) ((in_len >>  0) & 0xff);
-    }
-
-    /* return */
-    if (new_len != out_len)
-        _PyBytes_Resize(&result_str, header ? new_len + 5 : new_len);
+    if (dict_len != (lzo_uint) size)
+        _PyBytes_Resize(&result_str, dict_len);
 
     return result_str;
+
+nomem:
+    PyErr_NoMemory();
+error:
+    PyMem_Free(lens);
+    PyMem_Free(buf);
+    Py_DECREF(seq);
+    return NULL;
 }
 
 
 /***********************************************************************
-// decompress
+// analyze
 ************************************************************************/
 
-static /* const */ char decompress__doc__[] =
-"decompress(string[,header[,buflen[,algorithm]]]) -- Decompress the data in string, returning a string containing the decompressed data.\n"
-"header - Metadata header is included in input (default: True).\n"
-"buflen - If header is False, a buffer length in bytes must be given that "
-"will fit the output.\n"
-"algorithm (keyword argument) - can be either LZO1, LZO1A, LZO1B, LZO1C, LZO1F, LZO1X, LZO1Y, LZO1Z, LZO2A."
-"(default: LZO1X).\n"
+static /* const */ char analyze__doc__[] =
+"analyze(string[,level]) -- Compress string with LZO1X and return a dict of "
+"statistics of the compressed data: 'length' and 'compressed_length', "
+"'classes' with the 'count', uncompressed 'bytes' and compressed "
+"'code_bytes' of the literal runs and of the M1, M2, M3 and M4 matches, "
+"and the histograms 'match_lengths' and 'literal_runs' (length: count, "
+"the last key 256 counts all longer ones) and 'offsets' (the smallest "
+"offset of each power of two: count). The 3 bytes of the end marker "
+"are in no class.\n"
+"level - As for compress() (default: 1).\n"
 ;
 
+/* {key: count} of the non-empty buckets of a histogram */
 static PyObject *
-decompress(PyObject *dummy, PyObject *args, PyObject *kwds)
+histogram_dict(const lzo_uint *h, int n, int offsets)
 {
-    PyObject *result_str;
+    PyObject *d = PyDict_New();
+    int i;
+
+    if (d == NULL)
+        return NULL;
+    for (i = 0; i < n; i++)
+    {
+        PyObject *k, *v;
+        int r;
+
+        if (h[i] == 0)
+            continue;
+        k = PyLong_FromSize_t(offsets ? (size_t) 1 << (i - 1) : (size_t) i);
+        v = PyLong_FromSize_t(h[i]);
+        r = (k != NULL && v != NULL) ? PyDict_SetItem(d, k, v) : -1;
+        Py_XDECREF(k);
+        Py_XDECREF(v);
+        if (r < 0)
+        {
+            Py_DECREF(d);
+            return NULL;
+        }
+    }
+    return d;
+}
+
+static PyObject *
+analyze(PyObject *module, PyObject *args)
+{
+    static const char *const class_names[5] = { "literal", "M1", "M2", "M3", "M4" };
+    lzo_state *st = get_lzo_state(module);
+    PyObject *compressed;
+    PyObject *classes = NULL;
+    PyObject *result = NULL;
     const lzo_bytep in;
-    lzo_bytep out;
-    lzo_uint in_len;
-    lzo_uint out_len;
-    lzo_uint new_len;
     Py_ssize_t len;
-    int buflen = -1;
-    int header = 1;
-    int err;
-
-    static char* argnames[] = {"", "", "", "algorithm", NULL};
-    char *algorithm = "LZO1X";
-    lzo_decompress_fn decompress_ptr;
+    int level = 1;
+    lzo1x_stats_t *stats;
+    int err, i;
 
     /* init */
-    UNUSED(dummy);
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s#|ii$s", argnames, &in, &len, &header, &buflen, &algorithm))
+    if (!PyArg_ParseTuple(args, "s#|i", &in, &len, &level))
         return NULL;
-    if (header) {
-        if (len < 5 + 3 || in[0] < 0xf0 || in[0] > 0xf1)
-            goto header_error;
-        out_len = ((lzo_uint)in[1] << 24) | (in[2] << 16) | (in[3] << 8) | in[4];
-        in_len = len - 5;
-        in += 5;
-        if (out_len < 0 || in_len > out_len + out_len / 64 + 16 + 3)
-            goto header_error;
-    }
-    else {
-        if (buflen < 0) return PyErr_Format(LzoError, "Argument buflen required for headerless decompression");
-        out_len = buflen;
-        in_len = len;
-    }
 
-    /* init for different algorithms*/
-    if (strcmp(algorithm, "LZO1") == 0) {
-      // settings specific for lzo1
-      decompress_ptr = &lzo1_decompress;
-    }
-    else if (strcmp(algorithm, "LZO1A") == 0){
-      // settings for LZO1A
-      decompress_ptr = &lzo1a_decompress;
-    }
-    else if (strcmp(algorithm, "LZO1B") == 0){
-      // settings for LZO1B
-      decompress_ptr = &lzo1b_decompress_safe;
-    }
-    else if (strcmp(algorithm, "LZO1C") == 0){
-      // settings for LZO1C
-      decompress_ptr = &lzo1c_decompress_safe;
-    }
-    else if (strcmp(algorithm, "LZO1F") == 0){
-      // settings for LZO1F
-      decompress_ptr = &lzo1f_decompress_safe;
-    }
-    else if (strcmp(algorithm, "LZO1Y") == 0){
-      // settings for LZO1Y
-      decompress_ptr = &lzo1y_decompress_safe;
-    }
-    else if (strcmp(algorithm, "LZO1Z") == 0){
-      // settings for LZO1Z
-      decompress_ptr = &lzo1z_decompress_safe;
+    compressed = compress_data(st, in, len, level, 0, 1, &algorithms[LZO_METHOD_LZO1X], NULL, NULL, NULL, 0);
+    if (compressed == NULL)
+        return NULL;
+    stats = (lzo1x_stats_t *) PyMem_Malloc(sizeof(*stats));
+    if (stats == NULL)
+    {
+        Py_DECREF(compressed);
+        return PyErr_NoMemory();
     }
-    else if (strcmp(algorithm, "LZO2A") == 0){
-      // settings for LZO2A
-      decompress_ptr = &lzo2a_decompress_safe;
+
+    /* analyze */
+    Py_BEGIN_ALLOW_THREADS
+    err = lzo1x_analyze((const lzo_bytep) PyBytes_AS_STRING(compressed),
+                        (lzo_uint) PyBytes_GET_SIZE(compressed), stats);
+    Py_END_ALLOW_THREADS
+    if (err != LZO_E_OK)
+    {
+        /* this should NEVER happen */
+        PyErr_Format(st->error, "Error %i while analyzing data", err);
+        goto done;
     }
-    else {
-      // settings for LZO1X
-      decompress_ptr = &lzo1x_decompress_safe;
+
+    classes = PyDict_New();
+    if (classes == NULL)
+        goto done;
+    for (i = 0; i < 5; i++)
+    {
+        PyObject *c = Py_BuildValue("{s:n,s:n,s:n}",
+                                    "count", (Py_ssize_t) stats->count[i],
+                                    "bytes", (Py_ssize_t) stats->bytes[i],
+                                    "code_bytes", (Py_ssize_t) stats->code_bytes[i]);
+        if (c == NULL || PyDict_SetItemString(classes, class_names[i], c) < 0)
+        {
+            Py_XDECREF(c);
+            goto done;
+        }
+        Py_DECREF(c);
     }
 
-    /* alloc buffers */
-    result_str = PyBytes_FromStringAndSize(NULL, out_len);
-    if (result_str == NULL)
-        return PyErr_NoMemory();
+    result = Py_BuildValue("{s:n,s:n,s:O,s:N,s:N,s:N}",
+                           "length", len,
+                           "compressed_length", PyBytes_GET_SIZE(compressed),
+                           "classes", classes,
+                           "match_lengths", histogram_dict(stats->match_len, LZO1X_STATS_MAX_LEN + 1, 0),
+                           "literal_runs", histogram_dict(stats->literal_run, LZO1X_STATS_MAX_LEN + 1, 0),
+                           "offsets", histogram_dict(stats->offset_bits, 17, 1));
+
+done:
+    Py_XDECREF(classes);
+    PyMem_Free(stats);
+    Py_DECREF(compressed);
+    return result;
+}
 
-    /* decompress */
-    out = (lzo_bytep) PyBytes_AsString(result_str);
 
-    Py_BEGIN_ALLOW_THREADS
-    new_len = out_len;
-    err = (*decompress_ptr)(in, in_len, out, &new_len, NULL);
-    Py_END_ALLOW_THREADS
+/***********************************************************************
+// set_allocator
+************************************************************************/
 
-    if (err != LZO_E_OK || (header && new_len != out_len) )
+static /* const */ char set_allocator__doc__[] =
+"set_allocator(allocator) -- Set where the work memory of the compressors "
+"and the scratch buffers of filters come from, for example hugepage-backed "
+"or NUMA-local memory.\n"
+"allocator - A callable, which is called as allocator(size) and returns "
+"a writable buffer of at least size bytes, such as an mmap or a "
+"bytearray; it is released when the call that needed it returns. Or a "
+"PyCapsule named 'lzo.callback' holding an lzo_callback_t whose nalloc "
+"and nfree are used. None restores the default, the pool of "
+"set_wrkmem_pool() for work memory and PyMem_Malloc for the rest.\n"
+;
+
+static PyObject *
+set_allocator(PyObject *module, PyObject *allocator)
+{
+    lzo_state *st = get_lzo_state(module);
+    PyObject *old;
+
+    if (allocator == Py_None)
+        allocator = NULL;
+    else if (PyCapsule_CheckExact(allocator))
     {
-        Py_DECREF(result_str);
-        PyErr_Format(LzoError, "Compressed data violation %i", err);
+        lzo_callback_p cb = (lzo_callback_p) PyCapsule_GetPointer(allocator, ALLOCATOR_CAPSULE);
+
+        if (cb == NULL)
+            return NULL;
+        if (cb->nalloc == 0 || cb->nfree == 0)
+        {
+            PyErr_SetString(PyExc_ValueError, "the lzo_callback_t needs nalloc and nfree");
+            return NULL;
+        }
+    }
+    else if (!PyCallable_Check(allocator))
+    {
+        PyErr_SetString(PyExc_TypeError, "allocator must be callable, a capsule or None");
         return NULL;
     }
 
-    if (!header && new_len != out_len)
-        _PyBytes_Resize(&result_str, new_len);
+    Py_XINCREF(allocator);
+    PyThread_acquire_lock(st->allocator_lock, WAIT_LOCK);
+    old = st->allocator;
+    st->allocator = allocator;
+    PyThread_release_lock(st->allocator_lock);
+    Py_XDECREF(old);
+    Py_RETURN_NONE;
+}
 
-    /* success */
-    return result_str;
+static /* const */ char get_allocator__doc__[] =
+"get_allocator() -- Return the allocator of set_allocator(), or None.\n"
+;
 
-header_error:
-    PyErr_SetString(LzoError, "Header error - invalid compressed data");
-    return NULL;
+static PyObject *
+get_allocator(PyObject *module, PyObject *unused)
+{
+    lzo_state *st = get_lzo_state(module);
+    PyObject *allocator;
+
+    UNUSED(unused);
+    PyThread_acquire_lock(st->allocator_lock, WAIT_LOCK);
+    allocator = st->allocator != NULL ? st->allocator : Py_None;
+    Py_INCREF(allocator);
+    PyThread_release_lock(st->allocator_lock);
+    return allocator;
 }
 
 
 /***********************************************************************
-// optimize
+// set_wrkmem_pool, wrkmem_pool_stats
 ************************************************************************/
 
-static /* const */ char optimize__doc__[] =
-"optimize(string[,header[,buflen]]) -- Optimize the representation of the "
-"compressed data, returning a string containing the compressed data.\n"
-"header - Metadata header is included in input (default: True).\n"
-"buflen - If header is False, a buffer length in bytes must be given that "
-"will fit the input/output.\n"
+static /* const */ char set_wrkmem_pool__doc__[] =
+"set_wrkmem_pool(max_bytes[, hugepage[, prefault]]) -- Configure the "
+"process-wide pool the default allocator takes the work memory of the "
+"compressors from. The pool maps 2 MiB arenas and hands out their "
+"regions again and again, so that small inputs do not pay a page fault "
+"per page of work memory on every call.\n"
+"max_bytes - The limit of all arenas; beyond it work memory is mapped "
+"per call. Unused arenas above the new limit are unmapped, so 0 empties "
+"the pool. The default is 16 MiB.\n"
+"hugepage  - Ask for transparent huge pages for new arenas (default True).\n"
+"prefault  - Touch every page of a new arena at once (default True).\n"
 ;
 
 static PyObject *
-optimize(PyObject *dummy, PyObject *args)
+set_wrkmem_pool(PyObject *module, PyObject *args)
 {
-    PyObject *result_str;
-    lzo_bytep in;
-    lzo_bytep out;
-    lzo_uint in_len;
-    lzo_uint out_len;
-    lzo_uint new_len;
-    Py_ssize_t len;
-    int err;
-    int header = 1;
-    int buflen = -1;
+    Py_ssize_t max_bytes;
+    int hugepage = 1, prefault = 1;
+    unsigned flags = 0;
 
-    /* init */
-    UNUSED(dummy);
-    if (!PyArg_ParseTuple(args, "s#|ii", &in, &len, &header, &buflen))
+    UNUSED(module);
+    if (!PyArg_ParseTuple(args, "n|pp", &max_bytes, &hugepage, &prefault))
         return NULL;
-    if (header) {
-        if (len < 5 + 3 || in[0] < 0xf0 || in[0] > 0xf1)
-            goto header_error;
-        in_len = len - 5;
-        out_len = (in[1] << 24) | (in[2] << 16) | (in[3] << 8) | in[4];
-        if ((int)out_len < 0 || in_len > out_len + out_len / 64 + 16 + 3)
-            goto header_error;
-    }
-    else {
-        if (buflen < 0) return PyErr_Format(LzoError, "Argument buflen required for headerless optimization");
-        out_len = buflen;
-        in_len = len;
-    }
-
-    /* alloc buffers */
-    result_str = PyBytes_FromStringAndSize(in, len);
-    if (result_str == NULL)
-        return PyErr_NoMemory();
-    out = (lzo_bytep) PyMem_Malloc(out_len > 0 ? out_len : 1);
-    if (out == NULL)
+    if (max_bytes < 0)
     {
-        Py_DECREF(result_str);
-        return PyErr_NoMemory();
+        PyErr_SetString(PyExc_ValueError, "max_bytes must not be negative");
+        return NULL;
     }
-
-    /* optimize */
-    in = (lzo_bytep) PyBytes_AsString(result_str);
-
-    Py_BEGIN_ALLOW_THREADS
-    new_len = out_len;
-    err = lzo1x_optimize( header ? in+5 : in, in_len, out, &new_len, NULL);
-    Py_END_ALLOW_THREADS
-
-    PyMem_Free(out);
-    if (err != LZO_E_OK || (header && new_len != out_len))
+    if (hugepage)
+        flags |= LZO_WRKMEM_HUGEPAGE;
+    if (prefault)
+        flags |= LZO_WRKMEM_PREFAULT;
+    if (lzo_wrkmem_pool(flags, (lzo_uint) max_bytes) != LZO_E_OK)
     {
-        Py_DECREF(result_str);
-        PyErr_Format(LzoError, "Compressed data violation %i", err);
+        PyErr_SetString(PyExc_ValueError, "invalid wrkmem pool settings");
         return NULL;
     }
+    Py_RETURN_NONE;
+}
 
-    /* success */
-    return result_str;
+static /* const */ char wrkmem_pool_stats__doc__[] =
+"wrkmem_pool_stats() -- Return a dict of the counters of the work memory "
+"pool: hits (regions handed out again), misses (regions that needed a new "
+"arena), direct (work memory mapped outside the pool), arenas, bytes "
+"(mapped by the arenas) and free (regions not in use).\n"
+;
 
-header_error:
-    PyErr_SetString(LzoError, "Header error - invalid compressed data");
-    return NULL;
+static PyObject *
+wrkmem_pool_stats(PyObject *module, PyObject *unused)
+{
+    lzo_wrkmem_stats_t stats;
+
+    UNUSED(module);
+    UNUSED(unused);
+    lzo_wrkmem_stats(&stats);
+    return Py_BuildValue("{s:n,s:n,s:n,s:n,s:n,s:n}",
+                         "hits", (Py_ssize_t) stats.hits,
+                         "misses", (Py_ssize_t) stats.misses,
+                         "direct", (Py_ssize_t) stats.direct,
+                         "arenas", (Py_ssize_t) stats.arenas,
+                         "bytes", (Py_ssize_t) stats.bytes,
+                         "free", (Py_ssize_t) stats.free);
 }
 
 
@@ -517,10 +2610,20 @@ crc32(PyObject *dummy, PyObject *args)
 static /* const */ PyMethodDef methods[] =
 {
     {"adler32",    (PyCFunction)adler32,    METH_VARARGS, adler32__doc__},
-    {"compress",   (PyCFunction)compress,   METH_VARARGS | METH_KEYWORDS, compress__doc__},
+    {"analyze",    (PyCFunction)analyze,    METH_VARARGS, analyze__doc__},
+    {"compress",   (PyCFunction)(void(*)(void))compress,   METH_FASTCALL | METH_KEYWORDS, compress__doc__},
+    {"compress_bound", (PyCFunction)(void(*)(void))compress_bound, METH_FASTCALL | METH_KEYWORDS, compress_bound__doc__},
     {"crc32",      (PyCFunction)crc32,      METH_VARARGS, crc32__doc__},
-    {"decompress", (PyCFunction)decompress, METH_VARARGS | METH_KEYWORDS, decompress__doc__},
+    {"decompress", (PyCFunction)(void(*)(void))decompress, METH_FASTCALL | METH_KEYWORDS, decompress__doc__},
+    {"decompress_inplace", (PyCFunction)decompress_inplace, METH_VARARGS, decompress_inplace__doc__},
+    {"get_allocator", (PyCFunction)get_allocator, METH_NOARGS, get_allocator__doc__},
+    {"inplace_size", (PyCFunction)inplace_size, METH_VARARGS, inplace_size__doc__},
     {"optimize",   (PyCFunction)optimize,   METH_VARARGS, optimize__doc__},
+    {"optimize_into", (PyCFunction)optimize_into, METH_VARARGS, optimize_into__doc__},
+    {"set_allocator", (PyCFunction)set_allocator, METH_O, set_allocator__doc__},
+    {"set_wrkmem_pool", (PyCFunction)set_wrkmem_pool, METH_VARARGS, set_wrkmem_pool__doc__},
+    {"train_dictionary", (PyCFunction)train_dictionary, METH_VARARGS, train_dictionary__doc__},
+    {"wrkmem_pool_stats", (PyCFunction)wrkmem_pool_stats, METH_NOARGS, wrkmem_pool_stats__doc__},
     {NULL, NULL, 0, NULL}
 };
 
@@ -530,26 +2633,166 @@ static /* const */ char module_documentation[]=
 "using the LZO library.\n\n"
 "adler32(string)         -- Compute an Adler-32 checksum.\n"
 "adler32(string, start)  -- Compute an Adler-32 checksum using a given starting value.\n"
+"analyze(string)         -- Statistics of the LZO1X matches and literals of a string.\n"
 "compress(string)        -- Compress a string.\n"
 "compress(string, ...)   -- See help(lzo.compress) for more options.\n"
+"compress_bound(n, ...)  -- Largest size compress() returns for n bytes.\n"
 "crc32(string)           -- Compute a CRC-32 checksum.\n"
 "crc32(string, start)    -- Compute a CRC-32 checksum using a given starting value.\n"
 "decompress(string)      -- Decompresses a compressed string.\n"
 "decompress(string, ...) -- See help(lzo.decompress) for more options.\n"
+"decompress_inplace(buffer, n) -- Decompress within a writable buffer.\n"
 "optimize(string)        -- Optimize a compressed string.\n"
 "optimize(string, ...)   -- See help(lzo.optimize) for more options.\n"
+"optimize_into(buffer)   -- Optimize compressed data in a writable buffer in place.\n"
+"set_allocator(allocator) -- Set where work and scratch memory come from.\n"
+"set_wrkmem_pool(max_bytes) -- Configure the pool of pre-faulted work memory.\n"
+"train_dictionary(samples) -- Build a preset dictionary from sample strings.\n"
+"wrkmem_pool_stats()     -- Counters of the pool of work memory.\n"
 ;
 
+static int
+module_exec(PyObject *m)
+{
+    lzo_state *st = get_lzo_state(m);
+    int i;
+
+    if (lzo_init() != LZO_E_OK)
+    {
+        PyErr_SetString(PyExc_ImportError, "lzo_init() failed");
+        return -1;
+    }
+
+    st->allocator_lock = PyThread_allocate_lock();
+    if (st->allocator_lock == NULL)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    st->error = PyErr_NewException("lzo.error", NULL, NULL);
+    if (st->error == NULL)
+        return -1;
+    Py_INCREF(st->error);
+    if (PyModule_AddObject(m, "error", st->error) < 0)
+    {
+        Py_DECREF(st->error);
+        return -1;
+    }
+
+    st->str_algorithm = PyUnicode_InternFromString("algorithm");
+    st->str_threads = PyUnicode_InternFromString("threads");
+    st->str_optimize = PyUnicode_InternFromString("optimize");
+    st->str_filter = PyUnicode_InternFromString("filter");
+    st->str_typesize = PyUnicode_InternFromString("typesize");
+    st->str_progress = PyUnicode_InternFromString("progress");
+    st->str_progress_bytes = PyUnicode_InternFromString("progress_bytes");
+    st->str_cancel = PyUnicode_InternFromString("cancel");
+    st->str_timeout = PyUnicode_InternFromString("timeout");
+    st->str_dictionary = PyUnicode_InternFromString("dictionary");
+    if (st->str_algorithm == NULL || st->str_threads == NULL || st->str_optimize == NULL ||
+        st->str_filter == NULL || st->str_typesize == NULL || st->str_progress == NULL ||
+        st->str_progress_bytes == NULL || st->str_cancel == NULL || st->str_timeout == NULL ||
+        st->str_dictionary == NULL)
+        return -1;
+    for (i = 0; i < N_ALGORITHMS; i++)
+    {
+        st->names[i] = PyUnicode_InternFromString(algorithms[i].name);
+        if (st->names[i] == NULL || PyModule_AddIntConstant(m, algorithms[i].name, i) < 0)
+            return -1;
+    }
+
+    if (PyModule_AddStringConstant(m, "__author__", "Markus F.X.J. Oberhumer <markus@oberhumer.com>") < 0 ||
+        PyModule_AddStringConstant(m, "__version__", MODULE_VERSION) < 0 ||
+        PyModule_AddIntConstant(m, "LZO_VERSION", (long)lzo_version()) < 0 ||
+        PyModule_AddStringConstant(m, "LZO_VERSION_STRING", lzo_version_string()) < 0 ||
+        PyModule_AddStringConstant(m, "LZO_VERSION_DATE", lzo_version_date()) < 0)
+        return -1;
+
+    return 0;
+}
+
+static int
+module_traverse(PyObject *m, visitproc visit, void *arg)
+{
+    lzo_state *st = get_lzo_state(m);
+    int i;
+
+    Py_VISIT(st->error);
+    Py_VISIT(st->str_algorithm);
+    Py_VISIT(st->str_threads);
+    Py_VISIT(st->str_optimize);
+    Py_VISIT(st->str_filter);
+    Py_VISIT(st->str_typesize);
+    Py_VISIT(st->str_progress);
+    Py_VISIT(st->str_progress_bytes);
+    Py_VISIT(st->str_cancel);
+    Py_VISIT(st->str_timeout);
+    Py_VISIT(st->str_dictionary);
+    for (i = 0; i < N_ALGORITHMS; i++)
+        Py_VISIT(st->names[i]);
+    Py_VISIT(st->allocator);
+    return 0;
+}
+
+static int
+module_clear(PyObject *m)
+{
+    lzo_state *st = get_lzo_state(m);
+    int i;
+
+    Py_CLEAR(st->error);
+    Py_CLEAR(st->str_algorithm);
+    Py_CLEAR(st->str_threads);
+    Py_CLEAR(st->str_optimize);
+    Py_CLEAR(st->str_filter);
+    Py_CLEAR(st->str_typesize);
+    Py_CLEAR(st->str_progress);
+    Py_CLEAR(st->str_progress_bytes);
+    Py_CLEAR(st->str_cancel);
+    Py_CLEAR(st->str_timeout);
+    Py_CLEAR(st->str_dictionary);
+    for (i = 0; i < N_ALGORITHMS; i++)
+        Py_CLEAR(st->names[i]);
+    Py_CLEAR(st->allocator);
+    return 0;
+}
+
+static void
+module_free(void *m)
+{
+    lzo_state *st = get_lzo_state((PyObject *) m);
+
+    module_clear((PyObject *) m);
+    if (st != NULL && st->allocator_lock != NULL)
+    {
+        PyThread_free_lock(st->allocator_lock);
+        st->allocator_lock = NULL;
+    }
+}
+
+static PyModuleDef_Slot module_slots[] = {
+    {Py_mod_exec, (void *) module_exec},
+#if PY_VERSION_HEX >= 0x030c0000
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#if PY_VERSION_HEX >= 0x030d0000
+    /* the functions only touch their arguments and the module state */
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL}
+};
+
 static PyModuleDef module = {
     PyModuleDef_HEAD_INIT,
     "lzo", /* name */
     "Python bindings for the LZO data compression library", /* doc */
-    -1, /* size */
+    sizeof(lzo_state), /* size */
     methods, /* methods */
-    NULL, /* reload */
-    NULL, /* traverse */
-    NULL, /* clear */
-    NULL, /* free */
+    module_slots, /* slots */
+    module_traverse, /* traverse */
+    module_clear, /* clear */
+    module_free, /* free */
 };
 
 #ifdef _MSC_VER
@@ -557,35 +2800,7 @@ _declspec(dllexport)
 #endif
 PyMODINIT_FUNC PyInit_lzo(void)
 {
-    PyObject *m, *d, *v;
-
-    if (lzo_init() != LZO_E_OK)
-        return NULL;
-
-    m = PyModule_Create(&module);
-    d = PyModule_GetDict(m);
-
-    LzoError = PyErr_NewException("lzo.error", NULL, NULL);
-    PyDict_SetItemString(d, "error", LzoError);
-
-    v = PyUnicode_FromString("Markus F.X.J. Oberhumer <markus@oberhumer.com>");
-
-    PyDict_SetItemString(d, "__author__", v);
-    Py_DECREF(v);
-    v = PyUnicode_FromString(MODULE_VERSION);
-    PyDict_SetItemString(d, "__version__", v);
-    Py_DECREF(v);
-    v = PyLong_FromLong((long)lzo_version());
-    PyDict_SetItemString(d, "LZO_VERSION", v);
-    Py_DECREF(v);
-    v = PyUnicode_FromString(lzo_version_string());
-    PyDict_SetItemString(d, "LZO_VERSION_STRING", v);
-    Py_DECREF(v);
-    v = PyUnicode_FromString(lzo_version_date());
-    PyDict_SetItemString(d, "LZO_VERSION_DATE", v);
-    Py_DECREF(v);
-
-    return m;
+    return PyModuleDef_Init(&module);
 }
 
 
@@ -68,9 +68,37 @@ lzo_dir = os.environ.get("LZO_DIR", "lzo-2.10")  # Relative path.
 
 _use_system_lzo = has_system_lzo2()
 
+# Additions to the bundled LZO sources that a system liblzo2 does not
+# provide; these are always compiled in.  The 999 compressors are
+# rebuilt from the bundled sources as well: a system liblzo2 has them,
+# but without level 10, the binary tree match finder, progress/cancel
+# and the allocator hooks, and the definitions linked into the module
+# take precedence over those of the shared library.  _lzo1b_store_run()
+# and _lzo1c_store_run() are library-internal, so they come along.
+lzo_ext_sources = [
+    "src/lzo1x_di.c",
+    "src/lzo1x_os.c",
+    "src/lzo1y_os.c",
+    "src/lzo1x_tr.c",
+    "src/lzo1x_an.c",
+    "src/lzo_bound.c",
+    "src/lzo_pool.c",
+    "src/lzo1b_9x.c",
+    "src/lzo1c_9x.c",
+    "src/lzo1f_9x.c",
+    "src/lzo1x_9x.c",
+    "src/lzo1y_9x.c",
+    "src/lzo1z_9x.c",
+    "src/lzo2a_9x.c",
+    "src/lzo1b_rr.c",
+    "src/lzo1c_rr.c",
+]
+
 src_list = ["lzomodule.c"]
 if not _use_system_lzo:
     src_list += glob(os.path.join(lzo_dir, "src/*.c"))
+else:
+    src_list += [os.path.join(lzo_dir, f) for f in lzo_ext_sources]
 
 setup(
     cmdclass={
@@ -0,0 +1,336 @@
+##
+## vi:ts=4:et
+##
+##---------------------------------------------------------------------------##
+##
+## This file is part of the LZO real-time data compression library.
+##
+## Copyright (C) 1998-2002 Markus Franz Xaver Johannes Oberhumer
+## All Rights Reserved.
+##
+## The LZO library is free software; you can redistribute it and/or
+## modify it under the terms of the GNU General Public License as
+## published by the Free Software Foundation; either version 2 of
+## the License, or (at your option) any later version.
+##
+## The LZO library is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+##
+## You should have received a copy of the GNU General Public License
+## along with the LZO library; see the file COPYING.
+## If not, write to the Free Software Foundation, Inc.,
+## 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+##
+## Markus F.X.J. Oberhumer
+## <markus@oberhumer.com>
+## http://www.oberhumer.com/opensource/lzo/
+##
+##---------------------------------------------------------------------------##
+
+
+
+#
+# Benchmarks for the Python bindings, separate from the correctness tests:
+#
+#   python -m tests.bench_lzo [--quick] [--max-size 1G] [--json out.json]
+#
+# overhead   - time per call for 64 B ... 64 KiB inputs; a least squares
+#              fit of time against size splits it into the fixed cost of
+#              a call (ns/call) and the speed of the kernel (GB/s)
+# throughput - GB/s of compress() and decompress() for every algorithm,
+#              level and header setting, 64 B up to --max-size
+# buffers    - the cost of the accepted buffer types
+# scaling    - aggregate GB/s of 1, 2, 4, ... threads calling compress()
+#              and decompress() at once, which only scales while the GIL
+#              is released around the LZO calls
+# wrkmem     - latency of compress() for 64 B ... 4 KiB messages with the
+#              pool of pre-faulted work memory, and with the pool emptied
+#              so that every call maps and faults in fresh work memory
+#
+# Only the standard library is used. The data comes from tests/corpus.py,
+# so lzotest --synthetic-corpus measures the same bytes from C.
+#
+
+import argparse
+import json
+import os
+import sys
+import threading
+import time
+
+if __package__ in (None, ""):
+    sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from tests.util import get_sys_path
+sys.path = get_sys_path()
+
+import lzo
+from tests import corpus
+
+ALGORITHMS = ("LZO1", "LZO1A", "LZO1B", "LZO1C", "LZO1F", "LZO1X", "LZO1Y", "LZO1Z", "LZO2A")
+
+# generating more than this in Python is slow; larger inputs repeat it,
+# which is far outside the window of every LZO algorithm
+_TILE = 16 << 20
+
+
+def parse_size(s):
+    s = s.strip().upper().rstrip("B").rstrip("I")
+    mult = 1
+    for suffix, m in (("K", 1 << 10), ("M", 1 << 20), ("G", 1 << 30)):
+        if s.endswith(suffix):
+            s, mult = s[:-1], m
+    return int(s) * mult
+
+
+def format_size(n):
+    for suffix, m in (("G", 1 << 30), ("M", 1 << 20), ("K", 1 << 10)):
+        if n >= m and n % m == 0:
+            return "%d%s" % (n // m, suffix)
+    return "%dB" % n
+
+
+def make_data(kind, size, _cache={}):
+    key = (kind, min(size, _TILE))
+    if key not in _cache:
+        _cache[key] = corpus.generate(kind, key[1])
+    tile = _cache[key]
+    if size <= len(tile):
+        return tile[:size]
+    return (tile * (size // len(tile) + 1))[:size]
+
+
+def measure(fn, min_time, repeat=3):
+    """Return the best time of one call of fn() in ns."""
+    n = 1
+    while True:
+        t = time.perf_counter_ns()
+        for _ in range(n):
+            fn()
+        t = time.perf_counter_ns() - t
+        if t >= min_time * 1e9 or n >= 1 << 20:
+            break
+        n *= max(2, min(100, int(min_time * 1e9 / max(t, 1)) + 1))
+    best = t / n
+    for _ in range(repeat - 1):
+        t = time.perf_counter_ns()
+        for _ in range(n):
+            fn()
+        best = min(best, (time.perf_counter_ns() - t) / n)
+    return best
+
+
+def codec(data, algorithm, level, header):
+    c = lzo.compress(data, level, header, algorithm=algorithm)
+    if header:
+        d = lambda: lzo.decompress(c, algorithm=algorithm)
+    else:
+        d = lambda: lzo.decompress(c, False, len(data), algorithm=algorithm)
+    assert d() == data
+    return (lambda: lzo.compress(data, level, header, algorithm=algorithm)), d, len(c)
+
+
+def fit(points):
+    """Line through (size, ns) as (ns/call, GB/s), fitted by least squares
+    of the relative error so that the small inputs count as much as the
+    large ones."""
+    w = [1.0 / (y * y) for x, y in points]
+    sw = sum(w)
+    mx = sum(wi * x for wi, (x, y) in zip(w, points)) / sw
+    my = sum(wi * y for wi, (x, y) in zip(w, points)) / sw
+    sxx = sum(wi * (x - mx) ** 2 for wi, (x, y) in zip(w, points))
+    sxy = sum(wi * (x - mx) * (y - my) for wi, (x, y) in zip(w, points))
+    slope = sxy / sxx if sxx else 0
+    return max(my - slope * mx, 0), (1 / slope if slope > 0 else 0)
+
+
+def bench_overhead(args, results):
+    print("\n== per-call overhead (%s data, level 1) ==" % args.kind)
+    floor = measure(lambda: lzo.adler32(b""), args.min_time)
+    print("%-8s %-10s %-6s %12s %10s" % ("", "", "header", "ns/call", "GB/s"))
+    print("%-8s %-10s %-6s %12.1f %10s   lzo.adler32(b''), the cost of any call" % ("floor", "", "", floor, "-"))
+    results.append({"section": "overhead", "algorithm": None, "op": "floor", "ns_per_call": floor})
+    sizes = [64 << (2 * i) for i in range(6)]
+    for algorithm in args.algorithms:
+        for header in (True, False):
+            c_points, d_points = [], []
+            for size in sizes:
+                c, d, _ = codec(make_data(args.kind, size), algorithm, 1, header)
+                c_points.append((size, measure(c, args.min_time)))
+                d_points.append((size, measure(d, args.min_time)))
+            for op, points in (("compress", c_points), ("decompress", d_points)):
+                ns, gbps = fit(points)
+                print("%-8s %-10s %-6s %12.1f %10.3f" % (algorithm, op, header, ns, gbps))
+                results.append({"section": "overhead", "algorithm": algorithm, "op": op,
+                                "header": header, "ns_per_call": ns, "gbps": gbps})
+
+
+def bench_throughput(args, results):
+    print("\n== throughput (%s data) ==" % args.kind)
+    print("%-8s %5s %6s %6s %8s %10s %10s %12s %12s" %
+          ("", "level", "header", "size", "ratio", "c GB/s", "d GB/s", "c ns/call", "d ns/call"))
+    size = 64
+    sizes = []
+    while size <= args.max_size:
+        sizes.append(size)
+        size *= 4
+    if sizes[-1] != args.max_size:
+        sizes.append(args.max_size)
+    for algorithm in args.algorithms:
+        for level in args.levels:
+            for header in (True, False):
+                for size in sizes:
+                    if level > 1 and size > args.max_size_slow:
+                        continue
+                    data = make_data(args.kind, size)
+                    c, d, c_len = codec(data, algorithm, level, header)
+                    c_ns = measure(c, args.min_time)
+                    d_ns = measure(d, args.min_time)
+                    print("%-8s %5d %6s %6s %8.3f %10.3f %10.3f %12.0f %12.0f" %
+                          (algorithm, level, header, format_size(size), c_len / size,
+                           size / c_ns, size / d_ns, c_ns, d_ns))
+                    results.append({"section": "throughput", "algorithm": algorithm, "level": level,
+                                    "header": header, "size": size, "ratio": c_len / size,
+                                    "compress_gbps": size / c_ns, "decompress_gbps": size / d_ns,
+                                    "compress_ns_per_call": c_ns, "decompress_ns_per_call": d_ns})
+                    del data
+
+
+def bench_buffers(args, results):
+    import array
+    print("\n== buffer types (1 KiB %s data, LZO1X level 1) ==" % args.kind)
+    data = make_data(args.kind, 1024)
+    for name, buf in (("bytes", data), ("bytearray", bytearray(data)),
+                      ("memoryview", memoryview(data)), ("array", array.array("B", data))):
+        try:
+            lzo.compress(buf)
+        except TypeError as e:
+            print("%-10s %12s   %s" % (name, "n/a", e))
+            results.append({"section": "buffers", "type": name, "error": str(e)})
+            continue
+        ns = measure(lambda: lzo.compress(buf), args.min_time)
+        print("%-10s %12.1f ns/call" % (name, ns))
+        results.append({"section": "buffers", "type": name, "ns_per_call": ns})
+
+
+def bench_scaling(args, results):
+    size = min(1 << 20, args.max_size)
+    data = make_data(args.kind, size)
+    c = lzo.compress(data)
+    print("\n== thread scaling (%s %s data, LZO1X level 1) ==" % (format_size(size), args.kind))
+    gil = getattr(sys, "_is_gil_enabled", lambda: True)()
+    print("GIL %s, %d CPUs" % ("enabled" if gil else "disabled", os.cpu_count() or 1))
+    print("%7s %10s %10s %10s %10s" % ("threads", "c GB/s", "d GB/s", "c eff", "d eff"))
+    loops = max(1, int(args.scaling_bytes // size))
+    base = None
+    n = 1
+    while n <= args.threads:
+        speeds = []
+        for fn in (lambda: lzo.compress(data), lambda: lzo.decompress(c)):
+            barrier = threading.Barrier(n + 1)
+
+            def work():
+                barrier.wait()
+                for _ in range(loops):
+                    fn()
+                barrier.wait()
+
+            threads = [threading.Thread(target=work) for _ in range(n)]
+            for t in threads:
+                t.start()
+            barrier.wait()
+            t0 = time.perf_counter_ns()
+            barrier.wait()
+            speeds.append(n * loops * size / (time.perf_counter_ns() - t0))
+            for t in threads:
+                t.join()
+        if base is None:
+            base = speeds
+        eff = [100.0 * s / (n * b) for s, b in zip(speeds, base)]
+        print("%7d %10.3f %10.3f %9.1f%% %9.1f%%" % (n, speeds[0], speeds[1], eff[0], eff[1]))
+        results.append({"section": "scaling", "threads": n, "gil": gil,
+                        "compress_gbps": speeds[0], "decompress_gbps": speeds[1],
+                        "compress_efficiency": eff[0], "decompress_efficiency": eff[1]})
+        n *= 2
+
+
+def bench_wrkmem(args, results):
+    print("\n== work memory pool (%s data, LZO1X) ==" % args.kind)
+    print("%5s %6s %12s %12s %12s %8s" % ("level", "size", "pool ns", "hp+pf ns", "no pool ns", "speedup"))
+    configs = (("pool", (16 << 20, False, False)), ("hugepage", (16 << 20, True, True)),
+               ("none", (0,)))
+    try:
+        for level in args.levels:
+            for size in (64, 256, 1024, 4096):
+                data = make_data(args.kind, size)
+                ns = {}
+                for name, config in configs:
+                    lzo.set_wrkmem_pool(*config)
+                    ns[name] = measure(lambda: lzo.compress(data, level), args.min_time)
+                print("%5d %6s %12.0f %12.0f %12.0f %7.2fx" %
+                      (level, format_size(size), ns["pool"], ns["hugepage"], ns["none"],
+                       ns["none"] / ns["hugepage"]))
+                results.append({"section": "wrkmem", "level": level, "size": size,
+                                "pool_ns_per_call": ns["pool"],
+                                "hugepage_ns_per_call": ns["hugepage"],
+                                "no_pool_ns_per_call": ns["none"]})
+    finally:
+        lzo.set_wrkmem_pool(16 << 20)
+    print("pool: %s" % lzo.wrkmem_pool_stats())
+
+
+SECTIONS = {
+    "overhead": bench_overhead,
+    "throughput": bench_throughput,
+    "buffers": bench_buffers,
+    "scaling": bench_scaling,
+    "wrkmem": bench_wrkmem,
+}
+
+
+def main(argv=None):
+    p = argparse.ArgumentParser(description="Benchmark the python-lzo bindings.")
+    p.add_argument("--quick", action="store_true", help="small inputs and short runs")
+    p.add_argument("--sections", default=",".join(SECTIONS),
+                   help="comma separated subset of %s" % ", ".join(SECTIONS))
+    p.add_argument("--algorithms", default=",".join(ALGORITHMS))
+    p.add_argument("--levels", default="1,9")
+    p.add_argument("--kind", default="mixed", choices=corpus.KINDS, help="synthetic corpus kind")
+    p.add_argument("--max-size", type=parse_size, default=None,
+                   help="largest input, e.g. 1G (default 64M, 1M with --quick)")
+    p.add_argument("--max-size-slow", type=parse_size, default=parse_size("4M"),
+                   help="largest input for levels above 1 (default 4M)")
+    p.add_argument("--min-time", type=float, default=None,
+                   help="seconds per timing run (default 0.1, 0.01 with --quick)")
+    p.add_argument("--threads", type=int, default=max(os.cpu_count() or 1, 2))
+    p.add_argument("--scaling-bytes", type=parse_size, default=None,
+                   help="bytes per thread in the scaling test (default 256M, 8M with --quick)")
+    p.add_argument("--json", metavar="FILE", help="also write the results to FILE")
+    args = p.parse_args(argv)
+
+    args.algorithms = [a.strip().upper() for a in args.algorithms.split(",") if a.strip()]
+    args.levels = [int(l) for l in args.levels.split(",")]
+    if args.max_size is None:
+        args.max_size = parse_size("1M" if args.quick else "64M")
+    if args.min_time is None:
+        args.min_time = 0.01 if args.quick else 0.1
+    if args.scaling_bytes is None:
+        args.scaling_bytes = parse_size("8M" if args.quick else "256M")
+    if args.quick:
+        args.max_size_slow = min(args.max_size_slow, 64 << 10)
+
+    print("python-lzo %s, LZO %s, Python %s" % (lzo.__version__, lzo.LZO_VERSION_STRING, sys.version.split()[0]))
+    results = []
+    for name in args.sections.split(","):
+        SECTIONS[name.strip()](args, results)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"python": sys.version, "lzo": lzo.LZO_VERSION_STRING,
+                       "kind": args.kind, "results": results}, f, indent=1)
+    return results
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,173 @@
+##
+## vi:ts=4:et
+##
+##---------------------------------------------------------------------------##
+##
+## This file is part of the LZO real-time data compression library.
+##
+## Copyright (C) 1998-2002 Markus Franz Xaver Johannes Oberhumer
+## All Rights Reserved.
+##
+## The LZO library is free software; you can redistribute it and/or
+## modify it under the terms of the GNU General Public License as
+## published by the Free Software Foundation; either version 2 of
+## the License, or (at your option) any later version.
+##
+## The LZO library is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+##
+## You should have received a copy of the GNU General Public License
+## along with the LZO library; see the file COPYING.
+## If not, write to the Free Software Foundation, Inc.,
+## 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+##
+## Markus F.X.J. Oberhumer
+## <markus@oberhumer.com>
+## http://www.oberhumer.com/opensource/lzo/
+##
+##---------------------------------------------------------------------------##
+
+
+
+#
+# Deterministic synthetic test data: the same kind, size and seed always
+# give the same bytes. This is a port of lzo-2.10/lzotest/corpus.h, so
+#   lzotest --synthetic-corpus=SIZE --seed=N
+# measures exactly the data that generate(kind, SIZE, N) returns here.
+# Keep both files in sync.
+#
+
+import struct
+
+KINDS = ("text", "json", "numeric", "random", "zeros", "mixed")
+
+_MASK = (1 << 64) - 1
+
+
+class _Random:
+    """splitmix64"""
+
+    def __init__(self, seed):
+        self.state = seed & _MASK
+
+    def next(self):
+        self.state = (self.state + 0x9E3779B97F4A7C15) & _MASK
+        z = self.state
+        z = ((z ^ (z >> 30)) * 0xBF58476D1CE4E5B9) & _MASK
+        z = ((z ^ (z >> 27)) * 0x94D049BB133111EB) & _MASK
+        return z ^ (z >> 31)
+
+    def rand(self, n):
+        return self.next() % n
+
+
+def _text(g, size):
+    letters = "etaoinshrdlucmfwypvbgkjqxz"
+    vocab = []
+    for w in range(256):
+        n = 2 + g.rand(8)
+        word = []
+        for i in range(n):
+            a = g.rand(26)
+            b = g.rand(26)
+            word.append(letters[min(a, b)])
+        vocab.append("".join(word).encode("ascii"))
+
+    out = []
+    pos = prev = words = line = 0
+    sentence = 4 + g.rand(12)
+    while pos < size:
+        if g.rand(4) != 0:
+            w = (prev * 31 + g.rand(8)) % 256
+        else:
+            t = g.rand(256) + 1
+            w = g.rand(t)
+        prev = w
+        piece = vocab[w]
+        line += len(piece) + 1
+        words += 1
+        if words >= sentence:
+            piece += b"."
+            line += 1
+            words = 0
+            sentence = 4 + g.rand(12)
+        if line >= 72:
+            piece += b"\n"
+            line = 0
+        else:
+            piece += b" "
+        out.append(piece)
+        pos += len(piece)
+    return b"".join(out)[:size]
+
+
+def _json(g, size):
+    paths = ("users", "items", "orders", "search", "health")
+    ts = 1700000000000
+    out = []
+    pos = 0
+    while pos < size:
+        ts += g.rand(50)
+        l = g.rand(16)
+        level = "ERROR" if l == 0 else "WARN" if l < 3 else "DEBUG" if l < 6 else "INFO"
+        host = g.rand(16)
+        req = g.next() & 0xFFFFFFFF
+        path = g.rand(5)
+        id = g.rand(10000)
+        s = g.rand(20)
+        status = 500 if s == 0 else 404 if s == 1 else 302 if s == 2 else 200
+        t = g.rand(1000) + 1
+        ms = g.rand(t)
+        line = ('{"ts":%d,"level":"%s","host":"web-%02d","req":"%08x",'
+                '"path":"/api/v1/%s/%d","status":%d,"ms":%d}\n'
+                % (ts, level, host, req, paths[path], id, status, ms)).encode("ascii")
+        out.append(line)
+        pos += len(line)
+    return b"".join(out)[:size]
+
+
+def _numeric(g, size):
+    # u64 timestamp, i32 random walk, u16 category, u16 rare flag
+    row = struct.Struct("<QIHH")
+    ts = 1700000000000000
+    v = 0
+    out = []
+    for i in range((size + row.size - 1) // row.size):
+        ts += 1000 + g.rand(10)
+        v = (v + g.rand(201) - 100) & 0xFFFFFFFF
+        c = g.rand(8)
+        f = g.rand(64) == 0
+        out.append(row.pack(ts, v, c, f))
+    return b"".join(out)[:size]
+
+
+def _random(g, size):
+    n = (size + 7) // 8
+    return struct.pack("<%dQ" % n, *[g.next() for i in range(n)])[:size]
+
+
+def generate(kind, size, seed=0):
+    """Return `size' bytes of the synthetic corpus `kind' (see KINDS)."""
+    g = _Random(seed)
+    if kind == "text":
+        return _text(g, size)
+    if kind == "json":
+        return _json(g, size)
+    if kind == "numeric":
+        return _numeric(g, size)
+    if kind == "random":
+        return _random(g, size)
+    if kind == "zeros":
+        return bytes(size)
+    if kind == "mixed":
+        out = []
+        pos = 0
+        while pos < size:
+            n = min(size - pos, 65536)
+            k = KINDS[g.rand(5)]
+            out.append(generate(k, n, g.next()))
+            pos += n
+        return b"".join(out)
+    raise ValueError("unknown synthetic corpus kind %r" % (kind,))
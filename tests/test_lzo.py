@@ -32,12 +32,14 @@
 
 import inspect
 import pytest
-import sys, string
+import os, struct, sys, string
 
 # update sys.path when running in the build directory
 from tests.util import get_sys_path
 sys.path = get_sys_path()
 
+from tests import corpus
+
 import lzo
 
 
@@ -104,6 +106,10 @@ def gen_raw(src, level=1):
         raise lzo.error("internal error 2")
     print("compressed %6d -> %6d" % (len(src), len(c)))
 
+def gen_text(lines):
+    # numbered lines of text, compressible but not trivially so
+    return b"".join(b"%d: the quick brown fox %d jumps\n" % (i, i * i % 97) for i in range(lines))
+
 def test_version():
     if sys.version_info >= (3, 10):
         from importlib.metadata import version
@@ -146,6 +152,464 @@ def test_lzo_big_all():
 def test_lzo_big_raw():
     gen_raw(b" " * 131072)
 
+@pytest.mark.parametrize("algorithm", ["LZO1X", "LZO1Y", "LZO1Z"])
+def test_lzo_level10(algorithm):
+    src = gen_text(3000)
+    c9 = lzo.compress(src, 9, algorithm=algorithm)
+    c10 = lzo.compress(src, 10, algorithm=algorithm)
+    assert lzo.decompress(c10, algorithm=algorithm) == src
+    assert len(c10) <= len(c9)
+    # short matches between runs of 1 to 3 literals, where the cost of
+    # a match depends on the literals in front of it
+    abcd = bytes(b"abcd"[b & 3] for b in os.urandom(20000))
+    c10 = lzo.compress(abcd, 10, algorithm=algorithm)
+    assert lzo.decompress(c10, algorithm=algorithm) == abcd
+    assert len(c10) <= len(lzo.compress(abcd, 9, algorithm=algorithm))
+    # the optimal parser works in 4096 byte windows: runs that cross
+    # them, and incompressible data between text
+    noise = os.urandom(4096 * 3 + 5)
+    for src in (corpus.generate("mixed", 4096 * 5 + 77), src[:4000] + noise + src[:9000],
+                noise[:4095] + b"a" * 8193 + noise[:4097], noise):
+        c10 = lzo.compress(src, 10, algorithm=algorithm)
+        assert lzo.decompress(c10, algorithm=algorithm) == src
+        assert len(c10) <= lzo.compress_bound(len(src), algorithm=algorithm)
+
+@pytest.mark.parametrize("algorithm", ["LZO1B", "LZO1C"])
+def test_lzo_levels(algorithm):
+    src = corpus.generate("text", 1 << 17)
+    sizes = {}
+    for level in list(range(1, 10)) + [99, 999]:
+        c = lzo.compress(src, level, algorithm=algorithm)
+        assert lzo.decompress(c, algorithm=algorithm) == src
+        assert lzo.compress(src, level, algorithm=algorithm) == c
+        c2 = lzo.compress(src, level, 2, algorithm=algorithm, threads=2)
+        assert lzo.decompress(c2, algorithm=algorithm) == src
+        sizes[level] = len(c)
+    # each level is its own compressor, and the slow ones compress better
+    assert len(set(sizes.values())) >= 8
+    assert sizes[999] < sizes[99] < sizes[1]
+    for level in (0, 10, 42, 100):
+        with pytest.raises(ValueError):
+            lzo.compress(src, level, algorithm=algorithm)
+
+@pytest.mark.parametrize("algorithm", ["LZO1X", "LZO1Y", "LZO1Z"])
+def test_lzo_threads(algorithm):
+    src = gen_text(90000)
+    c = lzo.compress(src, 9, algorithm=algorithm)
+    m = lzo.compress(src, 9, algorithm=algorithm, threads=4)
+    assert len(src) > 2 * 1024 * 1024
+    assert lzo.decompress(m, algorithm=algorithm) == src
+    # each block sees the end of the previous one as dictionary
+    assert len(m) < len(c) * 1.01
+    assert lzo.compress(src, 9, algorithm=algorithm, threads=2) == m
+    assert lzo.decompress(lzo.compress(b"", 9, algorithm=algorithm, threads=2), algorithm=algorithm) == b""
+    with pytest.raises(lzo.error):
+        lzo.decompress(m[:-1], algorithm=algorithm)
+    with pytest.raises(ValueError):
+        lzo.compress(src, 1, algorithm=algorithm, threads=2)
+    with pytest.raises(ValueError):
+        lzo.compress(src, 9, False, algorithm=algorithm, threads=2)
+    with pytest.raises(ValueError):
+        lzo.compress(src, 9, algorithm="LZO1B", threads=2)
+
+@pytest.mark.parametrize("algorithm", ["LZO1", "LZO1A", "LZO1B", "LZO1C", "LZO1F", "LZO1X", "LZO1Y", "LZO1Z", "LZO2A"])
+def test_lzo_header64(algorithm):
+    src = gen_text(70000)
+    assert len(src) > 2 * 1024 * 1024
+    for level in (1, 9):
+        c = lzo.compress(src, level, 2, algorithm=algorithm)
+        assert c[0] == 0xf3
+        assert lzo.decompress(c, algorithm=algorithm) == src
+        assert lzo.compress(src, level, 2, algorithm=algorithm, threads=3) == c
+        with pytest.raises(lzo.error):
+            lzo.decompress(c[:-1], algorithm=algorithm)
+        with pytest.raises(lzo.error):
+            lzo.decompress(c[:13], algorithm=algorithm)
+    assert lzo.decompress(lzo.compress(b"", 1, 2, algorithm=algorithm), algorithm=algorithm) == b""
+    # the legacy header stays the default
+    assert lzo.compress(src, algorithm=algorithm)[0] == 0xf0
+
+def test_lzo_optimize_inplace():
+    src = gen_text(20000)
+    for level in (1, 9):
+        c = lzo.compress(src, level)
+        buf = bytearray(c)
+        assert lzo.optimize_into(buf) is None
+        assert bytes(buf) == lzo.optimize(c)
+        assert lzo.decompress(bytes(buf)) == src
+        assert lzo.compress(src, level, optimize=True) == lzo.optimize(c)
+        raw = bytearray(lzo.compress(src, level, False))
+        lzo.optimize_into(memoryview(raw), False, len(src))
+        assert bytes(raw) == lzo.compress(src, level, False, optimize=True)
+        c = lzo.compress(src, level, algorithm="LZO1Y", optimize=True)
+        assert lzo.decompress(c, algorithm="LZO1Y") == src
+        c = lzo.compress(src * 20, level, 2, threads=2, optimize=True)
+        assert lzo.decompress(c) == src * 20
+    with pytest.raises(TypeError):
+        lzo.optimize_into(lzo.compress(src))
+    with pytest.raises(lzo.error):
+        lzo.optimize_into(bytearray(b"\xf1abc"))
+    with pytest.raises(ValueError):
+        lzo.compress(src, algorithm="LZO1Z", optimize=True)
+
+
+def test_lzo_compress_bound():
+    data = os.urandom(3 * 1024 * 1024 + 1234)
+    for algo in ("LZO1", "LZO1A", "LZO1B", "LZO1C", "LZO1F", "LZO1X", "LZO1Y", "LZO1Z", "LZO2A"):
+        for header in (0, 1, 2):
+            bound = lzo.compress_bound(len(data), header, algorithm=algo)
+            for level in (1, 9):
+                c = lzo.compress(data, level, header, algorithm=algo)
+                assert len(c) <= bound
+                assert lzo.decompress(c, header, len(data), algorithm=algo) == data
+    assert lzo.compress_bound(0, False) > 0
+    assert lzo.compress_bound(1000, algorithm="LZO2A") > lzo.compress_bound(1000)
+    assert lzo.compress_bound(1000, 0) < lzo.compress_bound(1000) < lzo.compress_bound(1000, 2)
+    with pytest.raises(ValueError):
+        lzo.compress_bound(-1)
+    with pytest.raises(OverflowError):
+        lzo.compress_bound(sys.maxsize)
+
+
+def test_lzo_filters():
+    series = b"".join(struct.pack("<q", 1700000000000 + i * 1000 + i % 7) for i in range(50000))
+    plain = len(lzo.compress(series))
+    for f in ("shuffle", "bitshuffle", "delta"):
+        for typesize in (1, 2, 3, 4, 8, 16, 255):
+            for data in (series, series[:-5], os.urandom(1001), b""):
+                c = lzo.compress(data, 1, filter=f, typesize=typesize)
+                assert lzo.decompress(c) == data
+        c = lzo.compress(series, 9, filter=f, typesize=8)
+        assert len(c) < plain
+        assert lzo.decompress(c) == series
+        c = lzo.compress(series * 10, 9, 2, threads=2, filter=f, algorithm="LZO1Y")
+        assert lzo.decompress(c, algorithm="LZO1Y") == series * 10
+        assert len(c) <= lzo.compress_bound(len(series) * 40, 2, algorithm="LZO1Y")
+    assert lzo.compress(series, filter=None) == lzo.compress(series)
+    with pytest.raises(ValueError):
+        lzo.compress(series, filter="zstd")
+    with pytest.raises(ValueError):
+        lzo.compress(series, filter="shuffle", typesize=0)
+    with pytest.raises(ValueError):
+        lzo.compress(series, 1, False, filter="shuffle")
+    with pytest.raises(lzo.error):
+        lzo.decompress(b"\xf4\x07\x08" + lzo.compress(series))
+
+
+def test_lzo_blocks_deterministic():
+    # the dictionary of one block must not leak into the next one that
+    # the same thread compresses
+    src = gen_text(70000) + corpus.generate("mixed", 3 << 20)
+    for algorithm, level in (("LZO1C", 5), ("LZO1C", 1), ("LZO1F", 1)):
+        c = lzo.compress(src, level, 2, algorithm=algorithm)
+        for _ in range(3):
+            assert lzo.compress(src, level, 2, algorithm=algorithm, threads=4) == c
+        assert lzo.decompress(c, algorithm=algorithm) == src
+    c = lzo.compress(src, algorithm="auto")
+    assert lzo.compress(src, algorithm="auto", threads=4) == c
+
+def test_lzo_auto():
+    text = gen_text(40000)
+    noise = os.urandom(1 << 20)
+    data = text + noise + os.urandom(4096) * 256 + text[:1000]
+    for threads in (1, 3):
+        c = lzo.compress(data, algorithm="auto", threads=threads)
+        assert c[0] == 0xf5
+        assert lzo.decompress(c) == data
+        assert lzo.decompress(c, algorithm="LZO1Z") == data
+        assert len(c) <= lzo.compress_bound(len(data), algorithm="auto")
+        # the random block is stored, the repeated one is not
+        assert len(c) < len(text) + len(noise)
+    for data in (b"", b"x", noise[:100], text[:20000]):
+        assert lzo.decompress(lzo.compress(data, algorithm="auto")) == data
+    # 4 to 16 KiB that compress poorly but do not look random
+    for n in (4095, 4096, 4097, 8191, 12345, 16384, 16385):
+        data = bytes(b % 200 for b in noise[:n])
+        assert lzo.decompress(lzo.compress(data, algorithm="auto")) == data
+    c = lzo.compress(text, algorithm="auto", filter="delta", typesize=1)
+    assert lzo.decompress(c) == text
+    with pytest.raises(ValueError):
+        lzo.compress(text, 9, algorithm="auto")
+    with pytest.raises(ValueError):
+        lzo.compress(text, 1, False, algorithm="auto")
+    with pytest.raises(ValueError):
+        lzo.compress(text, algorithm="auto", optimize=True)
+    with pytest.raises(ValueError):
+        lzo.compress_bound(100, False, algorithm="auto")
+    with pytest.raises(ValueError):
+        lzo.decompress(text, algorithm="auto")
+    c = bytearray(lzo.compress(text, algorithm="auto"))
+    c[13] = 0x42
+    with pytest.raises(lzo.error):
+        lzo.decompress(bytes(c))
+    # a block may only name the methods that compress() writes
+    for m in range(256):
+        if m in (lzo.LZO1F, lzo.LZO1X, lzo.LZO1Y, 0xff):
+            continue
+        c[13] = m
+        with pytest.raises(lzo.error):
+            lzo.decompress(bytes(c))
+    bogus = bytes([0xf5]) + struct.pack(">QI", 4096, 1 << 20) + bytes([lzo.LZO1]) + struct.pack(">I", 3) + b"\xff" * 3
+    with pytest.raises(lzo.error):
+        lzo.decompress(bogus)
+
+
+def test_lzo_decompress_inplace():
+    src = gen_text(20000)
+    for data in (src, os.urandom(70000), b""):
+        for level in (1, 9):
+            for header in (True, False):
+                c = lzo.compress(data, level, header)
+                buf = bytearray(lzo.inplace_size(len(data)))
+                buf[-len(c):] = c
+                n = lzo.decompress_inplace(buf, len(c), header, len(data))
+                assert n == len(data)
+                assert bytes(buf[:n]) == data
+    c = lzo.compress(src)
+    buf = bytearray(lzo.inplace_size(len(src)) - 1)
+    buf[-len(c):] = c
+    with pytest.raises(ValueError):
+        lzo.decompress_inplace(buf, len(c))
+    with pytest.raises(TypeError):
+        lzo.decompress_inplace(c, len(c))
+    with pytest.raises(lzo.error):
+        lzo.decompress_inplace(bytearray(lzo.compress(src, 1, False)), 10, False)
+    buf = bytearray(lzo.inplace_size(len(src)))
+    buf[-len(c):] = c[:-1] + b"\x01"
+    with pytest.raises(lzo.error):
+        lzo.decompress_inplace(buf, len(c))
+
+def test_synthetic_corpus():
+    # pinned: lzotest --synthetic-corpus=65536 reports the same checksums
+    expected = {
+        "text": 0x98317040, "json": 0x2df38d60, "numeric": 0x1a56364b,
+        "random": 0xc5c92c19, "zeros": 0x000f0001, "mixed": 0x9523c425,
+    }
+    for kind in corpus.KINDS:
+        data = corpus.generate(kind, 65536)
+        assert len(data) == 65536
+        assert lzo.adler32(data) == expected[kind]
+        assert corpus.generate(kind, 1000, 1) != corpus.generate(kind, 1000, 2) or kind == "zeros"
+        assert lzo.decompress(lzo.compress(data)) == data
+    with pytest.raises(ValueError):
+        corpus.generate("silesia", 100)
+
+
+def test_bench_smoke(capsys):
+    from tests import bench_lzo
+    results = bench_lzo.main(["--quick", "--algorithms", "LZO1X,LZO1Y", "--levels", "1",
+                              "--max-size", "4K", "--min-time", "0.0005",
+                              "--threads", "2", "--scaling-bytes", "64K"])
+    sections = set(r["section"] for r in results)
+    assert sections == {"overhead", "throughput", "buffers", "scaling", "wrkmem"}
+    assert all(r["compress_gbps"] > 0 for r in results if r["section"] == "throughput")
+
+
+def test_lzo_algorithm_constants():
+    src = b"abcabcabcabcabcabcabcabc" * 10
+    for algo in ["LZO1", "LZO1A", "LZO1B", "LZO1C", "LZO1F", "LZO1X", "LZO1Y", "LZO1Z", "LZO2A"]:
+        k = getattr(lzo, algo)
+        assert lzo.compress(src, algorithm=k) == lzo.compress(src, algorithm=algo)
+        assert lzo.decompress(lzo.compress(src, 9, algorithm=algo), algorithm=k) == src
+        # names built at run time are not interned
+        assert lzo.compress(src, algorithm="".join(algo)) == lzo.compress(src, algorithm=k)
+    with pytest.warns(DeprecationWarning):
+        assert lzo.compress(src, algorithm="LZO3") == lzo.compress(src, algorithm="LZO1X")
+    with pytest.warns(DeprecationWarning):
+        assert lzo.decompress(lzo.compress(src), algorithm="LZO3") == src
+    with pytest.raises(ValueError):
+        lzo.decompress(lzo.compress(src), algorithm=9)
+    with pytest.raises(TypeError):
+        lzo.compress(src, algorithm=1.0)
+    with pytest.raises(TypeError):
+        lzo.compress(src, 1, True, None)
+    with pytest.raises(TypeError):
+        lzo.compress(src, level=1)
+    with pytest.raises(TypeError):
+        lzo.compress()
+    with pytest.raises(TypeError):
+        lzo.compress(src, 1.5)
+    with pytest.raises(TypeError):
+        lzo.decompress(src, nosuch=1)
+
+def test_train_dictionary():
+    samples = [b"GET /api/v1/users/%d HTTP/1.1\r\nHost: example.com\r\n" % i * 40
+               for i in range(200)]
+    d = lzo.train_dictionary(samples)
+    assert 0 < len(d) <= 0xbfff
+    assert len(lzo.train_dictionary(samples, 1024)) <= 1024
+    # small sample sets are returned as they are
+    assert lzo.train_dictionary([b"abc", b"def"]) == b"abcdef"
+    assert lzo.train_dictionary([]) == b""
+    with pytest.raises(ValueError):
+        lzo.train_dictionary(samples, 0xc000)
+    with pytest.raises(TypeError):
+        lzo.train_dictionary([u"text"])
+    # a sample that was not trained on compresses better with it
+    held_out = b"GET /api/v1/users/%d HTTP/1.1\r\nHost: example.com\r\n" % 12345
+    for algo in ("LZO1X", "LZO1Y", "LZO1Z"):
+        for level in (9, 10):
+            plain = lzo.compress(held_out, level, algorithm=algo)
+            c = lzo.compress(held_out, level, algorithm=algo, dictionary=d)
+            assert len(c) < len(plain)
+            assert lzo.decompress(c, algorithm=algo, dictionary=d) == held_out
+    # with and without a header, and longer than one sample
+    src = held_out * 4
+    for header in (True, False):
+        plain = lzo.compress(src, 9, header)
+        c = lzo.compress(src, 9, header, dictionary=d)
+        assert len(c) < len(plain)
+        assert lzo.decompress(c, header, len(src), dictionary=d) == src
+    # the dictionary is applied to the filtered bytes
+    c = lzo.compress(src, 9, filter="delta", typesize=1, dictionary=d)
+    assert lzo.decompress(c, dictionary=d) == src
+    for kw in ({"level": 1}, {"threads": 2}, {"header": 2}, {"optimize": True}):
+        level = kw.pop("level", 9)
+        with pytest.raises(ValueError):
+            lzo.compress(held_out, level, kw.pop("header", True), dictionary=d, **kw)
+    with pytest.raises(ValueError):
+        lzo.compress(held_out, 9, algorithm="LZO1B", dictionary=d)
+    with pytest.raises(ValueError):
+        lzo.decompress(lzo.compress(held_out, 9, algorithm="LZO1B"), algorithm="LZO1B", dictionary=d)
+
+def test_lzo_analyze():
+    data = corpus.generate("mixed", 1 << 18)
+    for level in (1, 9):
+        r = lzo.analyze(data, level)
+        classes = r["classes"]
+        assert r["length"] == len(data)
+        assert r["compressed_length"] == len(lzo.compress(data, level, False))
+        # every byte is produced by one code; the end marker takes 3 bytes
+        assert sum(c["bytes"] for c in classes.values()) == len(data)
+        assert sum(c["code_bytes"] for c in classes.values()) + 3 == r["compressed_length"]
+        matches = sum(classes[m]["count"] for m in ("M1", "M2", "M3", "M4"))
+        assert sum(r["match_lengths"].values()) == matches
+        assert sum(r["offsets"].values()) == matches
+        assert sum(r["literal_runs"].values()) == classes["literal"]["count"]
+        assert max(r["offsets"]) <= 0x8000
+    # a run of a single byte is mostly long M3 matches at offset 1
+    r = lzo.analyze(b"\0" * 100000)
+    assert r["classes"]["M3"]["bytes"] > 99000
+    assert r["match_lengths"][256] > 0 and r["offsets"][1] > 0
+    assert lzo.analyze(b"")["classes"]["literal"]["count"] == 0
+
+def test_lzo_progress():
+    import threading
+    data = corpus.generate("text", 1 << 21)
+    for threads in (1, 4):
+        calls = []
+        c = lzo.compress(data, 9, threads=threads, progress=lambda done, total: calls.append((done, total)),
+                         progress_bytes=1 << 18)
+        assert c == lzo.compress(data, 9, threads=threads)
+        assert calls[-1] == (len(data), len(data))
+        assert [d for d, _ in calls] == sorted(d for d, _ in calls)
+        if threads == 1:
+            assert len(calls) >= 8
+
+    cancel = threading.Event()
+    def stop_half_way(done, total):
+        if done >= total // 2:
+            cancel.set()
+    with pytest.raises(lzo.error):
+        lzo.compress(data, 10, progress=stop_half_way, progress_bytes=1 << 16, cancel=cancel)
+    with pytest.raises(TimeoutError):
+        lzo.compress(data * 2, 10, timeout=0.01)
+    with pytest.raises(ZeroDivisionError):
+        lzo.compress(data, 9, threads=2, progress=lambda done, total: 1 // 0)
+    with pytest.raises(ValueError):
+        lzo.compress(data, 1, progress=print)
+    with pytest.raises(TypeError):
+        lzo.compress(data, 9, cancel=True)
+
+def test_lzo_allocator():
+    import mmap
+    data = corpus.generate("mixed", 1 << 21)
+    sizes = []
+    def alloc(n):
+        sizes.append(n)
+        return mmap.mmap(-1, n)
+    assert lzo.get_allocator() is None
+    lzo.set_allocator(alloc)
+    try:
+        assert lzo.get_allocator() is alloc
+        for level, threads in ((1, 1), (9, 1), (10, 1), (9, 2)):
+            c = lzo.compress(data, level, threads=threads)
+            assert lzo.decompress(c) == data
+        assert lzo.decompress(lzo.compress(data, filter="shuffle")) == data
+        # work memory of both levels and the filter's scratch buffer
+        assert len(set(sizes)) == 4 and max(sizes) >= len(data)
+
+        lzo.set_allocator(lambda n: bytes(n))
+        with pytest.raises(BufferError):
+            lzo.compress(data)
+        lzo.set_allocator(lambda n: bytearray(16))
+        with pytest.raises(ValueError):
+            lzo.compress(data, 9, threads=2)
+        with pytest.raises(TypeError):
+            lzo.set_allocator(42)
+    finally:
+        lzo.set_allocator(None)
+    assert lzo.get_allocator() is None
+
+def test_lzo_wrkmem_pool():
+    data = corpus.generate("json", 4096)
+    lzo.set_wrkmem_pool(16 << 20)
+    try:
+        for level in (1, 9, 1, 9):
+            assert lzo.decompress(lzo.compress(data, level)) == data
+        s = lzo.wrkmem_pool_stats()
+        # one arena per size of work memory, reused from then on
+        assert s["hits"] >= 2 and s["arenas"] >= 2
+        assert s["bytes"] % (2 << 20) == 0 and s["free"] > 0
+        # a reused dictionary does not change the output of level 1
+        other = corpus.generate("text", 4096)
+        for algo in ("LZO1C", "LZO1F", "LZO1X", "LZO1Y"):
+            c = lzo.compress(data, 1, algorithm=algo)
+            lzo.compress(other, 1, algorithm=algo)
+            assert lzo.compress(data, 1, algorithm=algo) == c
+        # a filled pool maps per call
+        lzo.set_wrkmem_pool(0, False, False)
+        assert lzo.wrkmem_pool_stats()["arenas"] == 0
+        direct = lzo.wrkmem_pool_stats()["direct"]
+        assert lzo.decompress(lzo.compress(data, 9, threads=2)) == data
+        assert lzo.wrkmem_pool_stats()["direct"] > direct
+        with pytest.raises(ValueError):
+            lzo.set_wrkmem_pool(-1)
+    finally:
+        lzo.set_wrkmem_pool(16 << 20)
+
+def test_lzo_concurrent():
+    # many threads on the same module; the free-threaded build runs them
+    # in parallel, so a shared buffer or global would show up here
+    import threading
+    from concurrent.futures import ThreadPoolExecutor
+    algos = ["LZO1", "LZO1A", "LZO1B", "LZO1C", "LZO1F", "LZO1X", "LZO1Y", "LZO1Z", "LZO2A"]
+    barrier = threading.Barrier(8)
+
+    def work(t):
+        barrier.wait()
+        for i in range(40):
+            src = b"".join(b"%d %d %d\n" % (t, i, j * j % (t + 7)) for j in range(200 + 50 * t))
+            algo = algos[(t + i) % len(algos)]
+            level = 9 if i % 4 == 0 else 1
+            c = lzo.compress(src, level, algorithm=algo)
+            assert lzo.decompress(c, algorithm=algo) == src
+            assert lzo.adler32(src) == lzo.adler32(lzo.decompress(lzo.compress(src)))
+            assert lzo.crc32(src, t) == lzo.crc32(src, t)
+            with pytest.raises(lzo.error):
+                lzo.decompress(c[:-1], algorithm=algo)
+        return t
+
+    with ThreadPoolExecutor(8) as ex:
+        assert sorted(ex.map(work, range(8))) == list(range(8))
+    if hasattr(sys, "_is_gil_enabled") and sysconfig_gil_disabled():
+        # importing the module must not have turned the GIL back on
+        assert not sys._is_gil_enabled()
+
+def sysconfig_gil_disabled():
+    import sysconfig
+    return bool(sysconfig.get_config_var("Py_GIL_DISABLED"))
+
 
 def is_pypy():
     if sys.version_info >= (3, 3):